@@ -0,0 +1,6 @@
+#pragma once
+
+// Heap allocations made by the process so far. They are only counted in
+// builds with PHASEVIZ_COUNT_ALLOCATIONS defined, which replace the global
+// operator new; other builds return -1.
+long long allocationCount();
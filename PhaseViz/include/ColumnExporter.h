@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ThreeBodySolver.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams orbits to a directory of NumPy .npy files, one per column, so they
+// can be opened with numpy.load(path, mmap_mode='r') without copying:
+//
+//   positions.npy    float64 (N, 9)   body positions of every vertex
+//   velocities.npy   float64 (N, 9)   body velocities of every vertex
+//   projected.npy    float32 (N, 3)   projected vertex coordinates
+//   energy.npy       float64 (N,)     total energy of every vertex
+//   offsets.npy      int64   (M + 1,) vertices of orbit i are rows
+//                                     offsets[i] to offsets[i + 1]
+//   orbit_index.npy  int64   (M,)     generator index of every orbit
+//
+// Orbits are written in the order they are submitted by a background thread,
+// so producers submit them as they complete. An orbit can also be submitted
+// in several pieces as it grows; orbit_index then repeats, once per piece.
+// Headers have a fixed size and are rewritten with the final shapes by
+// finish().
+class ColumnExporter
+{
+public:
+    explicit ColumnExporter(std::string const &outDir);
+    ~ColumnExporter();
+
+    void submit(long long orbitIndex, std::vector<ThreeBodySystem> states,
+                std::vector<float> line);
+    bool finish();
+
+    static bool concatenate(std::vector<std::string> const &inDirs,
+                            std::string const &outDir);
+
+private:
+    struct PendingOrbit
+    {
+        long long orbitIndex;
+        std::vector<ThreeBodySystem> states;
+        std::vector<float> line;
+    };
+
+    struct Column
+    {
+        FILE *f;
+        char const *descr;
+        int width;
+        long long rows;
+    };
+
+    enum ColumnId {
+        POSITIONS, VELOCITIES, PROJECTED, ENERGY, OFFSETS, ORBIT_INDEX, NUM_COLUMNS
+    };
+
+    void run();
+    bool writeOrbit(PendingOrbit const &orbit);
+    bool writeRows(ColumnId id, void const *data, long long rows);
+
+private:
+    Column columns[NUM_COLUMNS];
+    long long numVertices;
+    bool ok;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<PendingOrbit> queue;
+    bool finishing;
+    bool finished;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Screen space histogram of orbit segments. Every thread rasterizes into its
+// own tile and tiles are summed into the map afterwards, so accumulation
+// needs no synchronisation. New vertices can be added to an existing map as
+// long as the view does not change.
+class DensityMap
+{
+public:
+    DensityMap();
+
+    void resize(int width, int height);
+    void clear();
+    void accumulate(std::vector<std::vector<float>> const &lines,
+                    unsigned int firstVertex, glm::mat4 const &mvp);
+    void toneMap(std::vector<unsigned char> &rgba) const;
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+private:
+    void splatSegment(std::vector<float> &tile, float x0, float y0,
+                      float x1, float y1) const;
+    void mergeTiles();
+
+private:
+    int w, h;
+    std::vector<float> density;
+    std::vector<std::vector<float>> tiles;
+};
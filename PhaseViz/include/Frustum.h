@@ -0,0 +1,13 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// View frustum as six planes (a, b, c, d) with a*x + b*y + c*z + d >= 0 on
+// the inside.
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+Frustum frustumFromMatrix(glm::mat4 const &m);
+bool boxInFrustum(Frustum const &f, glm::vec3 const &lo, glm::vec3 const &hi);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Measures the GPU time of the commands issued between begin and end with
+// GL_TIME_ELAPSED queries. Two queries alternate so that a result is only
+// read once the frame after it has been submitted, without stalling.
+class GpuTimer
+{
+public:
+    GpuTimer();
+    ~GpuTimer();
+    void begin();
+    void end();
+    // Last result available, in ms, or a negative value if there is none
+    double lastMs() const { return elapsedMs; }
+
+private:
+    GLuint queries[2];
+    bool pending[2];
+    int current;
+    bool running;
+    double elapsedMs;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ThreeBodySolver.h"
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Keeps a set of systems integrating frame after frame. The newest vertices
+// of every system are kept in a ring of ringLength vertices, plus one extra
+// vertex mirroring vertex 0 so that a wrapped ring can be drawn as two line
+// strips without a gap between them.
+//
+// Each call to advance spends roughly budgetMs on integration, spread across
+// OpenMP threads. The number of steps per system is rescaled after every
+// frame from the measured time, so the frame rate holds whatever the number
+// of systems.
+class LiveIntegrator
+{
+public:
+    LiveIntegrator();
+    void reset(std::vector<OrbitCursor> const &systems,
+               std::vector<glm::vec3> const &colors, unsigned int ringLength);
+    void advance(ThreeBodySolver &solver, float *positions, double budgetMs);
+    void writeColors(float *colors) const;
+
+    unsigned int numSystems() const {
+        return static_cast<unsigned int>(cursors.size());
+    }
+    // Vertices per system in the position buffer passed to advance
+    unsigned int slotSize() const { return ringLength + 1; }
+    unsigned int ringHead(int system) const { return heads[system]; }
+    unsigned int ringCount(int system) const { return counts[system]; }
+    int stepsPerFrame() const { return std::max(1, static_cast<int>(stepRate)); }
+    long long lastFrameSteps() const { return frameSteps; }
+    double lastFrameMs() const { return frameMs; }
+
+private:
+    std::vector<OrbitCursor> cursors;
+    std::vector<glm::vec3> systemColors;
+    // Next vertex written and vertices in use of every ring
+    std::vector<unsigned int> heads;
+    std::vector<unsigned int> counts;
+    unsigned int ringLength;
+    // Steps per system and frame, kept fractional so that it can grow from 1
+    double stepRate;
+    long long frameSteps;
+    double frameMs;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ThreeBodySolver.h"
+
+#include <glm/glm.hpp>
+#include <mutex>
+#include <vector>
+
+// Orbits are split in chunks of ORBIT_CHUNK_SIZE segments for culling. Chunk
+// k covers vertices [k*ORBIT_CHUNK_SIZE, (k+1)*ORBIT_CHUNK_SIZE], so that
+// consecutive chunks share a vertex and together draw the whole line strip.
+const unsigned int ORBIT_CHUNK_SIZE = 256;
+
+struct OrbitChunk
+{
+    glm::vec3 lo, hi;
+};
+
+// Storage of a single orbit
+struct OrbitBuffers
+{
+    std::vector<ThreeBodySystem> states;
+    std::vector<float> line;
+    std::vector<OrbitChunk> chunks;
+};
+
+// Chunks needed by an orbit of numVertices vertices
+inline size_t orbitChunkCount(size_t numVertices)
+{
+    return numVertices < 2 ? 0 : (numVertices - 2) / ORBIT_CHUNK_SIZE + 1;
+}
+
+// Orbit buffers kept for reuse once their orbit is discarded, so that
+// generating orbits no longer than earlier ones does not touch the heap.
+// Buffers can be acquired and released from any thread.
+class OrbitBufferPool
+{
+public:
+    OrbitBufferPool();
+    // Empty buffers with room for numVertices vertices
+    OrbitBuffers acquire(size_t numVertices);
+    void release(OrbitBuffers &&buffers);
+
+private:
+    std::mutex poolMutex;
+    std::vector<OrbitBuffers> spare;
+};
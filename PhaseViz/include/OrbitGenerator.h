@@ -1,23 +1,101 @@
 #pragma once
 
-#include "RenderGL.h"
+#include "ColumnExporter.h"
+#include "LiveIntegrator.h"
+#include "OrbitBufferPool.h"
+#include "PhaseCovariance.h"
+#include "PoincareSection.h"
+#include "SegmentBVH.h"
+#include "ThreeBodySolver.h"
 
+#include <glm/glm.hpp>
 #include <memory>
+#include <string>
+#include <vector>
+
+ThreeBodySystem randomSystem();
+
+// Work done by the last generateData/extendData call. allocations counts
+// the heap allocations made while integrating, or is -1 when the build does
+// not count them (see AllocationCounter.h).
+struct GenerationStats
+{
+    int orbits;
+    long long steps;
+    double ms;
+    long long allocations;
+};
 
 class OrbitGenerator
 {
 public:
     void generateData();
+    bool extendData(int numVertices);
+    bool startExport(std::string const &outDir);
+    bool stopExport();
+    bool exporting() const { return exporter != nullptr; }
+    bool writePaged(std::string const &path) const;
+    void setPrincipalProjection(bool enabled);
+    bool usesPrincipalProjection() const { return principalProjection; }
+    void startLive(int numSystems, unsigned int ringLength);
+    void advanceLive(float *positions, double budgetMs);
+    LiveIntegrator const &liveSystems() const { return live; }
+    void generateSection(SectionPlane const &plane, int numSystems,
+                         int crossingsPerSystem);
 	std::vector<std::vector<float>> computeColors();
 	void updateColors();
-	std::vector<std::vector<float>> orbitLines() const {
+	std::vector<std::vector<float>> const &orbitLines() const {
 		return lines;
 	}
+    std::vector<float> const &sectionPoints() const {
+        return sectionVertices;
+    }
+    std::vector<float> const &sectionColors() const {
+        return sectionVertColors;
+    }
+    std::vector<std::vector<OrbitChunk>> const &orbitChunks() const {
+        return chunks;
+    }
+    ThreeBodySystem const &orbitState(int orbit, int vertex) const {
+        return states[orbit][vertex];
+    }
+    bool pick(glm::vec3 const &origin, glm::vec3 const &dir, float radius,
+              PickResult &result) const {
+        return segmentIndex.pick(lines, origin, dir, radius, result);
+    }
+    GenerationStats const &lastGeneration() const { return generation; }
+    size_t memoryUsage() const;
+    unsigned int orbitLength() const {
+        return lines.empty() ? 0 : static_cast<unsigned int>(lines[0].size() / 3);
+    }
 
 private:
     void nextColoredBody() { coloredBody = (coloredBody+1)%3; }
+    void updateChunks(int orbit, unsigned int firstNewVertex);
+    void updateProjection();
 
 private:
+	std::vector<std::vector<ThreeBodySystem>> states;
 	std::vector<std::vector<float>> lines;
+    // Final integrator state of every orbit, used to continue it later.
+    std::vector<OrbitCursor> cursors;
+    std::vector<glm::vec3> orbitColors;
+    std::vector<std::vector<OrbitChunk>> chunks;
+    SegmentBVH segmentIndex;
+    // Covariance of every state generated since the last generateData
+    PhaseCovariance covariance;
+    bool principalProjection = false;
+    GenerationStats generation = {0, 0, 0.0, 0};
+    // Buffers of discarded orbits, reused by generateData
+    OrbitBufferPool pool;
+    // Streams orbits to NumPy columns as they are integrated, while exporting
+    std::unique_ptr<ColumnExporter> exporter;
+    // Export index of the first of the current orbits
+    long long firstExportedOrbit = 0;
+    // Systems animated in the live view
+    LiveIntegrator live;
+    // Poincare section crossings, projected, as a flat point cloud
+    std::vector<float> sectionVertices;
+    std::vector<float> sectionVertColors;
     int coloredBody;
 };
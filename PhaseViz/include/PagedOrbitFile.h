@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Paged orbit files hold projected orbit vertices in pages of at most
+// PAGE_VERTICES vertices so that a viewer can stream the parts it needs.
+// Every orbit is split in level 0 pages of PAGE_VERTICES vertices,
+// consecutive pages sharing a vertex like the chunks of OrbitGenerator.
+// Level 1 pages keep every PAGE_LOD_STRIDE-th vertex, so that level 1 page j
+// covers the same stretch of orbit as level 0 pages
+// [j*PAGE_LOD_STRIDE, (j+1)*PAGE_LOD_STRIDE).
+//
+// Overview pages, at level OVERVIEW_LEVEL, span orbits: overview page g
+// holds orbits [g*OVERVIEW_ORBITS, (g+1)*OVERVIEW_ORBITS), each as a strip
+// of OVERVIEW_VERTICES vertices spread along the whole orbit. They keep a
+// view of many orbits within a few pages.
+//
+// Layout: a PagedFileHeader, the pages packed back to back, the page
+// directory (one PageInfo per page) and an RGB color per orbit.
+const unsigned int PAGE_VERTICES = 16384;
+const unsigned int PAGE_LOD_STRIDE = 16;
+// Levels made of pages of a single orbit
+const unsigned int PAGE_LEVELS = 2;
+const unsigned int OVERVIEW_LEVEL = PAGE_LEVELS;
+const unsigned int OVERVIEW_VERTICES = 256;
+const unsigned int OVERVIEW_ORBITS = PAGE_VERTICES / OVERVIEW_VERTICES;
+
+struct PagedFileHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t pageVertices;
+    std::uint32_t lodStride;
+    std::uint32_t overviewVertices;
+    std::uint32_t overviewOrbits;
+    std::uint64_t numOrbits;
+    std::uint64_t numPages;
+    std::uint64_t directoryOffset;
+};
+
+struct PageInfo
+{
+    // The first orbit, for an overview page
+    std::uint32_t orbit;
+    std::uint32_t level;
+    // Position of the page among those of the same orbit and level, or among
+    // the overview pages
+    std::uint32_t index;
+    std::uint32_t numVertices;
+    // File offset of the vertices
+    std::uint64_t offset;
+    // Bounds of the vertices covered, which for a level 1 page are those of
+    // its level 0 pages and for an overview page those of its orbits.
+    float lo[3];
+    float hi[3];
+};
+
+extern const char pagedFileMagic[4];
+const std::uint32_t pagedFileVersion = 3;
+
+// Writes a paged orbit file from orbits whose vertices arrive in pieces.
+// Orbits can be interleaved; each keeps one partially filled page per level
+// in memory until endOrbit or finish, and its overview strip until all the
+// orbits of its overview page are ended.
+class PagedOrbitWriter
+{
+public:
+    PagedOrbitWriter();
+    ~PagedOrbitWriter();
+    bool open(std::string const &path);
+    int addOrbit(glm::vec3 const &color);
+    void addVertices(int orbit, float const *vertices, size_t numVertices);
+    void endOrbit(int orbit);
+    bool finish();
+
+private:
+    struct OpenOrbit
+    {
+        std::vector<float> pages[PAGE_LEVELS];
+        std::uint32_t numPages[PAGE_LEVELS];
+        std::uint64_t numVertices;
+        bool ended;
+        // Bounds of the level 0 pages under the open level 1 page
+        glm::vec3 lo, hi;
+        // Bounds of the whole orbit
+        glm::vec3 orbitLo, orbitHi;
+        // Every sampleStride-th vertex, made the overview strip by endOrbit
+        std::vector<float> samples;
+        std::uint64_t sampleStride;
+    };
+
+    void pushVertex(int orbit, int level, float const *vertex);
+    void flushPage(int orbit, int level);
+    void pushSample(OpenOrbit &open, float const *vertex);
+    void flushOverviews(bool all);
+    void writePage(PageInfo &info, std::vector<float> const &vertices);
+
+    std::FILE *file;
+    std::string path;
+    std::string tmpPath;
+    bool failed;
+    // Where the next page goes
+    std::uint64_t dataOffset;
+    // Overview pages written so far
+    std::uint32_t numOverviews;
+    std::vector<PageInfo> directory;
+    std::vector<OpenOrbit> orbits;
+    std::vector<glm::vec3> colors;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Frustum.h"
+#include "PagedOrbitFile.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+typedef std::shared_ptr<const std::vector<float>> PageData;
+
+// A page wanted for the current view. Every page but an overview one has a
+// parent, the coarser page covering the same vertices, and parent is the
+// position of that page among the requests, or -1.
+struct PageRequest
+{
+    std::uint32_t page;
+    float priority;
+    int parent;
+};
+
+// Read side of a paged orbit file. Only the page directory stays in memory;
+// pages are read by a loader thread into an LRU cache of bounded size, in
+// the order of the last requests made.
+class PagedOrbitStore
+{
+public:
+    PagedOrbitStore();
+    ~PagedOrbitStore();
+    bool open(std::string const &path, size_t cacheBytes);
+
+    size_t numPages() const { return directory.size(); }
+    size_t numOrbits() const { return colors.size(); }
+    unsigned int pageVertices() const { return header.pageVertices; }
+    unsigned int overviewVertices() const { return header.overviewVertices; }
+    PageInfo const &page(std::uint32_t id) const { return directory[id]; }
+    glm::vec3 const &orbitColor(std::uint32_t orbit) const { return colors[orbit]; }
+
+    // Picks the pages for a view: the visible overview pages, then, largest
+    // on screen first, pages covering more than lodPixels are refined in
+    // their visible finer pages while the selection stays within maxPages.
+    // Refined pages stay selected, as the parents of their finer pages, so
+    // all the pages selected fit together in maxPages. Requests are in load
+    // order, coarser levels first, and parents come before their children.
+    // Returns the number of visible overview pages left out, when even those
+    // do not fit.
+    size_t selectPages(Frustum const &frustum, glm::vec3 const &eye,
+                       float pixelsPerRadian, float lodPixels, size_t maxPages,
+                       std::vector<PageRequest> &wanted);
+    // Replaces the pages waiting to be loaded, which are loaded in order
+    void request(std::vector<PageRequest> const &wanted);
+    // The page if it is in memory, or null
+    PageData cachedPage(std::uint32_t id);
+    // Whether reading the page failed. Such pages are never read again.
+    bool pageFailed(std::uint32_t id) const;
+
+    size_t cachedBytes() const;
+    unsigned long long pagesLoaded() const;
+
+private:
+    void loaderLoop();
+    PageData readPage(std::uint32_t id);
+    void refine(PageInfo const &info, Frustum const &frustum,
+                std::vector<std::uint32_t> &children) const;
+
+    PagedFileHeader header;
+    std::vector<PageInfo> directory;
+    std::vector<glm::vec3> colors;
+    // levelPages[level][orbit][index] is the id of that page
+    std::vector<std::vector<std::uint32_t>> levelPages[PAGE_LEVELS];
+    std::vector<std::uint32_t> overviewPages;
+    // Reused by selectPages
+    std::vector<PageRequest> selection;
+    std::vector<std::pair<float, int>> refinable;
+    std::vector<std::uint32_t> children;
+    std::vector<int> loadOrder;
+    std::vector<int> positions;
+
+    std::FILE *file;
+    std::thread loader;
+    mutable std::mutex cacheMutex;
+    std::condition_variable pendingChanged;
+    bool stopping;
+    std::vector<PageRequest> pending;
+    size_t cacheLimit;
+    size_t cacheSize;
+    unsigned long long numLoaded;
+    // Most recently used first
+    std::list<std::uint32_t> lru;
+    struct CacheEntry
+    {
+        PageData data;
+        std::list<std::uint32_t>::iterator lruPos;
+    };
+    std::unordered_map<std::uint32_t, CacheEntry> cache;
+    std::unordered_set<std::uint32_t> failed;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ThreeBodySolver.h"
+
+// Streaming mean and covariance of phase space states (Welford). Memory use
+// does not depend on the number of states added, and accumulators filled by
+// different threads can be merged.
+class PhaseCovariance
+{
+public:
+    PhaseCovariance();
+
+    void clear();
+    void add(ThreeBodySystem const &s);
+    void merge(PhaseCovariance const &other);
+    long long count() const { return n; }
+    void principalAxes(double axes[3][PHASE_DIMS], double center[PHASE_DIMS]) const;
+
+private:
+    long long n;
+    double mean[PHASE_DIMS];
+    // Sum of products of deviations from the mean
+    double m2[PHASE_DIMS][PHASE_DIMS];
+};
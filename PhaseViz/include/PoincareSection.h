@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ThreeBodySolver.h"
+
+#include <vector>
+
+// Hyperplane normal . x = offset in the 18-D phase space. Components are
+// ordered as in Projection: the three body positions followed by the three
+// body velocities.
+struct SectionPlane
+{
+    double normal[PHASE_DIMS];
+    double offset;
+    // +1 keeps crossings where normal . x increases, -1 where it decreases
+    // and 0 keeps both.
+    int direction;
+};
+
+SectionPlane axisSection(int component, double offset, int direction);
+
+class PoincareSection
+{
+public:
+    explicit PoincareSection(SectionPlane const &sectionPlane);
+
+    int findCrossings(ThreeBodySolver &solver, OrbitCursor &cursor,
+                      int numCrossings, int maxSteps,
+                      std::vector<ThreeBodySystem> &crossings) const;
+
+private:
+    double planeValue(ThreeBodySystem const &s) const;
+    double planeRate(ThreeBodySystem const &s, SystemAccels const &a) const;
+    double findRoot(double g0, double d0, double g1, double d1, double h) const;
+
+private:
+    SectionPlane plane;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <initializer_list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+
+// Records timings as Chrome trace events (chrome://tracing, Perfetto) while a
+// trace is open. Events can be added from any thread; their tid is the
+// OpenMP thread number.
+class Profiler
+{
+public:
+    Profiler();
+    ~Profiler();
+    bool startTrace(std::string const &path);
+    void stopTrace();
+    bool tracing() const { return traceFile != 0; }
+    // Microseconds since the profiler was created
+    double now() const;
+    void complete(char const *name, double startUs, double durationUs,
+                  std::initializer_list<std::pair<char const *, double>> args = {});
+    void counters(char const *name,
+                  std::initializer_list<std::pair<char const *, double>> values);
+
+private:
+    void writeEvent(std::string const &event);
+    static void writeArgs(std::ostream &event,
+                          std::initializer_list<std::pair<char const *, double>> args);
+
+    std::chrono::high_resolution_clock::time_point origin;
+    std::FILE *traceFile;
+    bool firstEvent;
+    std::mutex traceMutex;
+};
+
+extern Profiler profiler;
+
+// Times the enclosing scope. The duration is stored in elapsedMs, when given,
+// and traced as a complete event, along with the bytes set by setBytes.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(char const *name, double *elapsedMs = 0);
+    ~ScopedTimer();
+    void setBytes(size_t bytes) { this->bytes = static_cast<double>(bytes); }
+
+private:
+    char const *name;
+    double *elapsedMs;
+    double startUs;
+    double bytes;
+};
@@ -4,6 +4,8 @@
 
 class ThreeBodySystem;
 
+const int PHASE_DIMS = 18;
+
 enum Axis {
     POS0, VEL0, POS1, VEL1, POS2, VEL2, AXIS_NELEMS
 };
@@ -13,11 +15,14 @@ public:
     Projection();
 
     void createMatrix();
+    void setRows(double const rows[3][PHASE_DIMS], double const center[PHASE_DIMS]);
 
     glm::dvec3 phaseSpaceToVizSpace(ThreeBodySystem const &s);
     glm::mat3x3 projMatrix(Axis selectedAxis);
 private:
     glm::dmat3x3 positions[3];
     glm::dmat3x3 velocities[3];
+    // Projection of the phase space point placed at the origin of viz space
+    glm::dvec3 offset;
 };
 
@@ -1,11 +1,21 @@
 #pragma once
 
+#include "DensityMap.h"
+#include "GpuTimer.h"
+#include "PagedOrbitStore.h"
 #include "ThreeBodySolver.h"
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+enum DrawMode {
+    DRAW_ORBITS, DRAW_SECTION, DRAW_DENSITY, DRAW_LIVE, DRAW_MODE_NELEMS
+};
+
 class RenderGL {
 public:
     RenderGL();
@@ -18,7 +28,14 @@ public:
     void moveBackward();
     void updateData(std::vector<std::vector<float>> const& lines,
                     std::vector<std::vector<float>> const& colors);
+    void appendData(std::vector<std::vector<float>> const& lines,
+                    std::vector<std::vector<float>> const& colors,
+                    unsigned int firstNewVertex);
+    void updateSection(std::vector<float> const& points,
+                       std::vector<float> const& colors);
+    void setDrawMode(DrawMode mode);
     void setProjAxes(glm::mat3 const &axes);
+    bool openPaged(std::string const &path);
 
 
 //    void mouseDrag(int x, int y);
@@ -27,16 +44,101 @@ public:
 
 
 private:
+    void allocateBuffer();
+    void pickOrbit(int x, int y);
+    void drawVertices();
+    void cullChunks();
+    void refreshDensity();
+    void drawDensity();
+    void startLive();
+    void drawLive();
+    void drawHud();
+    void drawPaged();
+    unsigned int leastRecentSlot() const;
+    void drawPage(std::uint32_t page, unsigned int slot);
+    size_t gpuMemoryUsage() const;
+    size_t ramUsage() const;
+    double uploadBandwidth() const;
+    void uploadVertices(std::vector<std::vector<float>> const& lines,
+                        std::vector<std::vector<float>> const& colors,
+                        unsigned int firstVertex);
+
     // GL UI stuff
     int dragPrevX = 0, dragPrevY = 0;
+    bool dragging = false;
 
     unsigned int numPoints;
     unsigned int numLines;
+    // Every orbit owns a slot of lineCapacity vertices in the VBO, of which
+    // the first lineLength are in use. Slots grow by doubling.
+    unsigned int lineLength;
+    unsigned int lineCapacity;
 
     GLuint vboId;
-    GLuint iboId;
+    GLuint sectionVboId;
+    unsigned int numSectionPoints;
+    DrawMode drawMode;
+
+    // Compacted ranges of visible orbit chunks for glMultiDrawArrays
+    std::vector<GLint> drawFirsts;
+    std::vector<GLsizei> drawCounts;
+    unsigned int numDrawnVertices;
+
+    // Density view. densityVertices is how many vertices of every orbit have
+    // been accumulated under densityMvp.
+    DensityMap density;
+    GLuint densityTexId;
+    glm::mat4 densityMvp;
+    unsigned int densityVertices;
     GLuint shaderId;
 
+    // Live view. Positions and colors of the live rings share liveVboId,
+    // persistently mapped at liveMapped when the driver supports it, or
+    // staged in liveStaging and uploaded every frame otherwise. liveFence
+    // guards the mapped positions still being read by the GPU.
+    GLuint liveVboId;
+    float *liveMapped;
+    std::vector<float> liveStaging;
+    GLsync liveFence;
+    bool liveTimerArmed;
+    // GLUT time, in ms, at which the next live frame is due
+    double nextFrameTime;
+
+    // Out-of-core view of a paged orbit file. Resident pages occupy slots of
+    // pageVertices vertices in pagePoolVboId. slotLastUse holds the last
+    // frame in which each slot was wanted.
+    std::unique_ptr<PagedOrbitStore> pagedStore;
+    GLuint pagePoolVboId;
+    std::vector<int> slotPages;
+    std::vector<unsigned long long> slotLastUse;
+    std::unordered_map<std::uint32_t, unsigned int> pageSlots;
+    std::vector<PageRequest> wantedPages;
+    // Per wanted page: whether it is on the GPU, whether it or the pages
+    // under it can be drawn, and whether it is drawn or hidden by a drawn
+    // parent
+    struct WantedState
+    {
+        bool resident;
+        bool hasChildren;
+        bool childrenCovered;
+        bool covered;
+        bool drawn;
+        bool hidden;
+    };
+    std::vector<WantedState> wantedStates;
+    // Visible overview pages that did not fit in the pool
+    size_t pagesLeftOut;
+    unsigned long long pagedFrame;
+
+    // HUD statistics. Frame times are those of the previous frame.
+    bool showHud;
+    GpuTimer gpuTimer;
+    double lastFrameStart;
+    double frameIntervalMs;
+    double frameCpuMs;
+    size_t lastUploadBytes;
+    double lastUploadMs;
+
     glm::vec3 eye;
     glm::mat4 modelMat;
     glm::mat4 modelMatInv;
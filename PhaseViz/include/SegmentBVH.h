@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct BVHNode
+{
+    glm::vec3 lo, hi;
+    // Leaves have count > 0 and reference items [first, first + count).
+    // Inner nodes have count == 0 and children first and first + 1.
+    int first;
+    int count;
+};
+
+struct BVHBox
+{
+    glm::vec3 lo, hi;
+};
+
+// Segment going from vertex to vertex + 1 of an orbit
+struct SegmentRef
+{
+    int orbit;
+    int vertex;
+};
+
+struct PickResult
+{
+    int orbit;
+    int vertex;
+    float distance;
+};
+
+// Bounding volume hierarchy over the segments of the projected orbits.
+// Segments are indexed in blocks of consecutive segments of one orbit. Blocks
+// are built in parallel and never touched again, so appending vertices to
+// the orbits only builds blocks for the new segments plus a small top level
+// tree over all blocks. clear() keeps the storage of the blocks and of the
+// build buffers, so that indexing orbits no longer than earlier ones does not
+// touch the heap.
+class SegmentBVH
+{
+public:
+    void clear();
+    void addSegments(std::vector<std::vector<float>> const &lines,
+                     unsigned int firstVertex);
+    bool pick(std::vector<std::vector<float>> const &lines,
+              glm::vec3 const &origin, glm::vec3 const &dir, float radius,
+              PickResult &result) const;
+    size_t numSegments() const;
+
+private:
+    struct Block
+    {
+        std::vector<BVHNode> nodes;
+        std::vector<SegmentRef> segments;
+    };
+
+    // Per thread buffers of the block builds
+    struct BuildBuffers
+    {
+        std::vector<BVHBox> boxes;
+        std::vector<int> order;
+    };
+
+    void buildTopLevel();
+    void pickBlock(std::vector<std::vector<float>> const &lines, Block const &block,
+                   glm::vec3 const &origin, glm::vec3 const &dir, glm::vec3 const &invDir,
+                   float radius, float &bestT, PickResult &result) const;
+
+private:
+    // Only the first numBlocks blocks are in use
+    std::vector<Block> blocks;
+    size_t numBlocks = 0;
+    std::vector<BVHNode> topNodes;
+    std::vector<int> blockOrder;
+    std::vector<SegmentRef> newBlocks;
+    std::vector<BVHBox> topBoxes;
+    std::vector<BuildBuffers> threadBuffers;
+};
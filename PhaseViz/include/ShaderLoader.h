@@ -0,0 +1,19 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+
+// Shader sources come from PHASEVIZ_SHADER_DIR when that variable is set, so
+// they can be edited without rebuilding. Otherwise builds defining
+// PHASEVIZ_EMBEDDED_SHADERS use the sources compiled into the executable,
+// and other builds read them from the working directory.
+std::string shaderSource(std::string const &name);
+
+// Compiles and links a program, or reloads it from the program binary cache
+// when the driver and the sources are those it was cached with.
+GLuint loadProgram(std::string const &vertexName, std::string const &fragmentName);
+
+// Times loading the program from sources and from the cache, and prints the
+// averages.
+int benchmarkProgramCache(std::string const &vertexName,
+                          std::string const &fragmentName, int iterations);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ColumnExporter.h"
+#include "ThreeBodySolver.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct SweepConfig
+{
+    int numOrbits;
+    int numPoints;
+    int shardSize;
+    // Seconds between checkpoints of a shard in progress
+    int checkpointSeconds;
+    unsigned int seed;
+};
+
+// Orbits of one shard, complete or in progress
+struct ShardData
+{
+    std::vector<OrbitCursor> cursors;
+    std::vector<std::vector<ThreeBodySystem>> states;
+    std::vector<std::vector<float>> lines;
+};
+
+// Long running generation job split in shards of shardSize orbits. Shards
+// are claimed through lock files in the job directory, so several worker
+// processes can share a job, and are checkpointed atomically while they run.
+// A restarted job only redoes the shards that were not finished, resuming
+// them from their last checkpoint.
+//
+// Job directory layout:
+//   job.cfg             job parameters, written by the first worker
+//   shard_<i>.lock      held by the worker processing shard i, holds the
+//                       time of its last refresh and the worker id,
+//                       <host>/<pid>/<start time>
+//   shard_<i>.ckpt      last checkpoint of shard i
+//   shard_<i>.done      output of finished shard i
+//   shard_<i>.columns   NumPy columns of finished shard i, exported in the
+//                       background while the worker goes on
+//   orbits.bin          all shards merged
+//   columns             NumPy columns of all shards
+class SweepJob
+{
+public:
+    SweepJob(std::string const &jobDir, SweepConfig const &defaults);
+
+    bool open(bool create);
+    int runWorker();
+    bool merge();
+    int numShards() const;
+
+private:
+    bool loadConfig();
+    void saveConfig() const;
+    bool claimShard(int shard);
+    bool ownsLock(int shard) const;
+    void releaseShard(int shard);
+    bool touchLock(int shard) const;
+    bool processShard(int shard);
+    void startShard(int shard, ShardData &data);
+    void exportShard(int shard, ShardData &data);
+    bool finishShardExport();
+    std::string shardPath(int shard, char const *extension) const;
+
+private:
+    std::string dir;
+    // Written in the locks of this worker, unique among the workers of a job
+    std::string workerId;
+    // Time at which this worker first found the lock of a shard unreadable
+    std::map<int, long long> unreadableLocks;
+    SweepConfig config;
+    ThreeBodySolver solver;
+    // Export of the last shard finished, written to a temporary directory
+    std::unique_ptr<ColumnExporter> shardExporter;
+    std::string shardExportDir;
+};
+
+bool writeShard(std::string const &path, ShardData const &data);
+bool readShard(std::string const &path, ShardData &data);
+int runSweepCommand(int argc, char **argv);
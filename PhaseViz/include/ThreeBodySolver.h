@@ -22,6 +22,20 @@ struct SystemAccels
     glm::dvec3 a1, a2, a3;
 };
 
+SystemAccels computeAccelerations(ThreeBodySystem s);
+void toPhaseVector(ThreeBodySystem const &s, double x[PHASE_DIMS]);
+double systemEnergy(ThreeBodySystem const &s);
+
+// Integrator state needed to resume an orbit exactly where it stopped.
+struct OrbitCursor
+{
+    ThreeBodySystem state;
+    double tStep;
+    glm::vec3 lastVert;
+    glm::vec3 lastOrbitPoint;
+    int numSteps;
+};
+
 class ThreeBodySolver
 {
 public:
@@ -29,9 +43,17 @@ public:
     void updateOccupancy(glm::vec3 const &p);
     bool isOccupied(glm::vec3 const &p);
     std::pair<std::vector<ThreeBodySystem>, std::vector<float>> computeOrbit(ThreeBodySystem &tbs, int numSteps);
+    OrbitCursor startOrbit(ThreeBodySystem const &tbs);
+    int extendOrbit(OrbitCursor &cursor, int numPoints,
+                    std::vector<ThreeBodySystem> &orbitStates,
+                    std::vector<float> &orbitVertices);
+    bool stepOrbit(OrbitCursor &cursor, glm::vec3 &vertex);
+    glm::vec3 advanceAdaptive(OrbitCursor &cursor, double &usedStep);
     void advanceStep(ThreeBodySystem &tbs, double tStep);
     glm::mat3 projectionAxes(Axis selectedAxis);
     glm::vec3 projectSystem(ThreeBodySystem const &tbs);
+    void setProjection(double const rows[3][PHASE_DIMS], double const center[PHASE_DIMS]);
+    void randomProjection();
 
 private:
     Projection p;
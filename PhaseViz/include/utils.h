@@ -2,4 +2,8 @@
 
 #include <glm/glm.hpp>
 
+#include <string>
+
 glm::dvec3 randomVector(double scale = 1.0);
+bool makeDirectory(std::string const &path);
+bool replaceFile(std::string const &tmpPath, std::string const &path);
@@ -0,0 +1,47 @@
+#include "AllocationCounter.h"
+
+#ifdef PHASEVIZ_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Constant initialized, so it is usable by allocations made before main
+std::atomic<long long> numAllocations(0);
+
+}
+
+// The array and nothrow forms of new and delete forward to these
+void *operator new(std::size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+long long allocationCount()
+{
+    return numAllocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+long long allocationCount()
+{
+    return -1;
+}
+
+#endif
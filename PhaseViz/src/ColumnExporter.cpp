@@ -0,0 +1,231 @@
+#include "ColumnExporter.h"
+#include "utils.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+// Every header takes this many bytes, which keeps the data 64 byte aligned
+// and leaves room to rewrite the shape once it is known.
+const int npyHeaderSize = 128;
+
+// Orbits waiting to be written before submit() blocks
+const size_t maxQueuedOrbits = 64;
+
+// In the order of ColumnExporter::ColumnId
+char const *const columnNames[] = {
+    "positions", "velocities", "projected", "energy", "offsets", "orbit_index"
+};
+char const *const columnDescrs[] = {"<f8", "<f8", "<f4", "<f8", "<i8", "<i8"};
+int const columnWidths[] = {9, 9, 3, 1, 1, 1};
+
+size_t itemSize(char const *descr)
+{
+    return descr[2] == '4' ? 4 : 8;
+}
+
+bool writeNpyHeader(FILE *f, char const *descr, long long rows, int width)
+{
+    std::ostringstream dict;
+    dict << "{'descr': '" << descr << "', 'fortran_order': False, 'shape': (" << rows;
+    if (width > 1) dict << ", " << width << "), }";
+    else dict << ",), }";
+
+    std::string header = dict.str();
+    header.resize(npyHeaderSize - 10 - 1, ' ');
+    header += '\n';
+
+    unsigned int headerLength = npyHeaderSize - 10;
+    unsigned char prefix[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+        static_cast<unsigned char>(headerLength & 0xff),
+        static_cast<unsigned char>(headerLength >> 8)};
+
+    return std::fseek(f, 0, SEEK_SET) == 0 &&
+        std::fwrite(prefix, 1, sizeof(prefix), f) == sizeof(prefix) &&
+        std::fwrite(header.data(), 1, header.size(), f) == header.size();
+}
+
+}
+
+ColumnExporter::ColumnExporter(std::string const &outDir) :
+    numVertices(0),
+    ok(true),
+    finishing(false),
+    finished(false)
+{
+    makeDirectory(outDir);
+    for (int i = 0; i < NUM_COLUMNS; ++i) {
+        std::string path = outDir + "/" + columnNames[i] + ".npy";
+        columns[i].f = std::fopen(path.c_str(), "wb");
+        columns[i].descr = columnDescrs[i];
+        columns[i].width = columnWidths[i];
+        columns[i].rows = 0;
+        if (!columns[i].f || !writeNpyHeader(columns[i].f, columnDescrs[i], 0, columnWidths[i])) {
+            std::cout << "Unable to write " << path << std::endl;
+            ok = false;
+        }
+    }
+
+    long long firstOffset = 0;
+    ok = ok && writeRows(OFFSETS, &firstOffset, 1);
+
+    worker = std::thread(&ColumnExporter::run, this);
+}
+
+ColumnExporter::~ColumnExporter()
+{
+    finish();
+}
+
+// Queues an orbit for writing. Blocks while the writer thread is too far
+// behind, to bound the memory held by the queue.
+void ColumnExporter::submit(long long orbitIndex, std::vector<ThreeBodySystem> states,
+                            std::vector<float> line)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return queue.size() < maxQueuedOrbits; });
+    queue.push_back(PendingOrbit());
+    queue.back().orbitIndex = orbitIndex;
+    queue.back().states = std::move(states);
+    queue.back().line = std::move(line);
+    changed.notify_all();
+}
+
+// Writes the remaining orbits, finalizes the headers and closes the files.
+// Returns false if any write failed.
+bool ColumnExporter::finish()
+{
+    if (finished) return ok;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finishing = true;
+    }
+    changed.notify_all();
+    worker.join();
+
+    for (auto &column : columns) {
+        if (!column.f) continue;
+        ok = writeNpyHeader(column.f, column.descr, column.rows, column.width) && ok;
+        ok = std::fclose(column.f) == 0 && ok;
+        column.f = 0;
+    }
+    finished = true;
+
+    std::cout << "Exported " << columns[ORBIT_INDEX].rows << " orbits, "
+        << numVertices << " vertices" << std::endl;
+    return ok;
+}
+
+void ColumnExporter::run()
+{
+    while (true) {
+        PendingOrbit orbit;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return !queue.empty() || finishing; });
+            if (queue.empty()) return;
+            orbit = std::move(queue.front());
+            queue.pop_front();
+        }
+        changed.notify_all();
+        if (ok) ok = writeOrbit(orbit);
+    }
+}
+
+bool ColumnExporter::writeOrbit(PendingOrbit const &orbit)
+{
+    long long n = static_cast<long long>(orbit.states.size());
+    std::vector<double> positions(9*n);
+    std::vector<double> velocities(9*n);
+    std::vector<double> energy(n);
+    for (long long v = 0; v < n; ++v) {
+        ThreeBodySystem const &s = orbit.states[v];
+        for (int b = 0; b < 3; ++b) {
+            for (int c = 0; c < 3; ++c) {
+                positions[9*v + 3*b + c] = s.body[b].position[c];
+                velocities[9*v + 3*b + c] = s.body[b].velocity[c];
+            }
+        }
+        energy[v] = systemEnergy(s);
+    }
+
+    numVertices += n;
+    return writeRows(POSITIONS, positions.data(), n) &&
+        writeRows(VELOCITIES, velocities.data(), n) &&
+        writeRows(PROJECTED, orbit.line.data(), n) &&
+        writeRows(ENERGY, energy.data(), n) &&
+        writeRows(OFFSETS, &numVertices, 1) &&
+        writeRows(ORBIT_INDEX, &orbit.orbitIndex, 1);
+}
+
+bool ColumnExporter::writeRows(ColumnId id, void const *data, long long rows)
+{
+    Column &column = columns[id];
+    size_t count = static_cast<size_t>(rows * column.width);
+    if (count > 0 && std::fwrite(data, itemSize(column.descr), count, column.f) != count) {
+        return false;
+    }
+    column.rows += rows;
+    return true;
+}
+
+// Joins the exports in inDirs, in order, into outDir. Column data is copied
+// as is, except for the offsets which continue from the previous export.
+bool ColumnExporter::concatenate(std::vector<std::string> const &inDirs,
+                                 std::string const &outDir)
+{
+    makeDirectory(outDir);
+    bool ok = true;
+    std::vector<char> buffer(1 << 20);
+    for (int i = 0; ok && i < NUM_COLUMNS; ++i) {
+        std::string path = outDir + "/" + columnNames[i] + ".npy";
+        FILE *out = std::fopen(path.c_str(), "wb");
+        ok = out && writeNpyHeader(out, columnDescrs[i], 0, columnWidths[i]);
+
+        size_t rowSize = itemSize(columnDescrs[i]) * columnWidths[i];
+        long long rows = 0;
+        long long firstOffset = 0;
+        if (ok && i == OFFSETS) {
+            ok = std::fwrite(&firstOffset, sizeof(firstOffset), 1, out) == 1;
+            rows = 1;
+        }
+        for (size_t d = 0; ok && d < inDirs.size(); ++d) {
+            std::string inPath = inDirs[d] + "/" + columnNames[i] + ".npy";
+            FILE *in = std::fopen(inPath.c_str(), "rb");
+            ok = in && std::fseek(in, npyHeaderSize, SEEK_SET) == 0;
+            if (ok && i == OFFSETS) {
+                // Every export starts at offset 0, which is already written
+                std::vector<long long> offsets;
+                long long offset;
+                while (std::fread(&offset, sizeof(offset), 1, in) == 1) {
+                    offsets.push_back(offset + firstOffset);
+                }
+                ok = !offsets.empty() &&
+                    (offsets.size() == 1 ||
+                     std::fwrite(&offsets[1], sizeof(offset), offsets.size() - 1, out) ==
+                        offsets.size() - 1);
+                if (ok) firstOffset = offsets.back();
+                rows += static_cast<long long>(offsets.size()) - 1;
+            } else if (ok) {
+                size_t bytes = 0;
+                size_t n;
+                while ((n = std::fread(&buffer[0], 1, buffer.size(), in)) > 0) {
+                    ok = ok && std::fwrite(&buffer[0], 1, n, out) == n;
+                    bytes += n;
+                }
+                ok = ok && bytes % rowSize == 0;
+                rows += static_cast<long long>(bytes / rowSize);
+            }
+            if (in) std::fclose(in);
+            if (!ok) std::cout << "Unable to read " << inPath << std::endl;
+        }
+
+        ok = ok && writeNpyHeader(out, columnDescrs[i], rows, columnWidths[i]);
+        if (out && std::fclose(out) != 0) ok = false;
+        if (!ok) std::cout << "Unable to write " << path << std::endl;
+    }
+    return ok;
+}
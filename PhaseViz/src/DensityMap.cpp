@@ -0,0 +1,173 @@
+#include "DensityMap.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+int maxThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+int threadId()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+// Liang-Barsky clipping of the segment against [0, w) x [0, h)
+bool clipSegment(float &x0, float &y0, float &x1, float &y1, float w, float h)
+{
+    const float eps = 1E-3f;
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {x0, w - eps - x0, y0, h - eps - y0};
+    float t0 = 0, t1 = 1;
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return false;
+            continue;
+        }
+        float t = q[i] / p[i];
+        if (p[i] < 0) t0 = std::max(t0, t);
+        else t1 = std::min(t1, t);
+        if (t0 > t1) return false;
+    }
+    x1 = x0 + t1*dx;
+    y1 = y0 + t1*dy;
+    x0 = x0 + t0*dx;
+    y0 = y0 + t0*dy;
+    return true;
+}
+
+}
+
+DensityMap::DensityMap() :
+    w(0),
+    h(0)
+{
+}
+
+void DensityMap::resize(int width, int height)
+{
+    w = width;
+    h = height;
+    density.assign(w*h, 0.0f);
+    tiles.assign(maxThreads(), std::vector<float>(w*h, 0.0f));
+}
+
+void DensityMap::clear()
+{
+    std::fill(density.begin(), density.end(), 0.0f);
+}
+
+// Adds the segments of every line ending at or after firstVertex.
+void DensityMap::accumulate(std::vector<std::vector<float>> const &lines,
+                            unsigned int firstVertex, glm::mat4 const &mvp)
+{
+    if (w == 0 || h == 0) return;
+
+#pragma omp parallel
+    {
+        std::vector<float> &tile = tiles[threadId()];
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < static_cast<int>(lines.size()); ++i) {
+            auto const &line = lines[i];
+            size_t numVerts = line.size() / 3;
+            size_t first = std::max(firstVertex, 1u);
+
+            bool prevVisible = false;
+            float prevX = 0, prevY = 0;
+            for (size_t v = first - 1; v < numVerts; ++v) {
+                glm::vec4 clip = mvp * glm::vec4(line[3*v], line[3*v + 1], line[3*v + 2], 1.0f);
+                bool visible = clip.w > 1E-6f;
+                float x = (clip.x / clip.w * 0.5f + 0.5f) * w;
+                float y = (clip.y / clip.w * 0.5f + 0.5f) * h;
+                if (visible && prevVisible) {
+                    splatSegment(tile, prevX, prevY, x, y);
+                }
+                prevVisible = visible;
+                prevX = x;
+                prevY = y;
+            }
+        }
+    }
+
+    mergeTiles();
+}
+
+void DensityMap::splatSegment(std::vector<float> &tile, float x0, float y0,
+                              float x1, float y1) const
+{
+    if (!clipSegment(x0, y0, x1, y1, static_cast<float>(w), static_cast<float>(h))) {
+        return;
+    }
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    int steps = static_cast<int>(std::max(std::abs(dx), std::abs(dy))) + 1;
+    float stepX = dx / steps;
+    float stepY = dy / steps;
+    float x = x0, y = y0;
+    for (int i = 0; i < steps; ++i) {
+        tile[static_cast<int>(y)*w + static_cast<int>(x)] += 1.0f;
+        x += stepX;
+        y += stepY;
+    }
+}
+
+// Parallel reduction of the per-thread tiles into the density map. Tiles are
+// left zeroed for the next accumulation.
+void DensityMap::mergeTiles()
+{
+#pragma omp parallel for
+    for (int i = 0; i < w*h; ++i) {
+        float sum = 0;
+        for (auto &tile : tiles) {
+            sum += tile[i];
+            tile[i] = 0;
+        }
+        density[i] += sum;
+    }
+}
+
+// Logarithmic tone mapping into a black-red-yellow-white ramp. Empty pixels
+// are fully transparent.
+void DensityMap::toneMap(std::vector<unsigned char> &rgba) const
+{
+    rgba.resize(4*w*h);
+
+    float maxDensity = 0;
+#pragma omp parallel
+    {
+        float threadMax = 0;
+#pragma omp for
+        for (int i = 0; i < w*h; ++i) {
+            threadMax = std::max(threadMax, density[i]);
+        }
+#pragma omp critical
+        maxDensity = std::max(maxDensity, threadMax);
+    }
+    float scale = maxDensity > 0 ? 1.0f / std::log(1.0f + maxDensity) : 0.0f;
+
+#pragma omp parallel for
+    for (int i = 0; i < w*h; ++i) {
+        float t = std::log(1.0f + density[i]) * scale;
+        rgba[4*i] = static_cast<unsigned char>(255 * std::min(1.0f, 3*t));
+        rgba[4*i + 1] = static_cast<unsigned char>(255 * std::min(1.0f, std::max(0.0f, 3*t - 1)));
+        rgba[4*i + 2] = static_cast<unsigned char>(255 * std::min(1.0f, std::max(0.0f, 3*t - 2)));
+        rgba[4*i + 3] = density[i] > 0 ? 255 : 0;
+    }
+}
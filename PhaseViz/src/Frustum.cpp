@@ -0,0 +1,35 @@
+#include "Frustum.h"
+
+// Planes are read off the rows of the model-view-projection matrix
+// (Gribb & Hartmann), so boxes are tested in model coordinates.
+Frustum frustumFromMatrix(glm::mat4 const &m)
+{
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; ++i) {
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+
+    Frustum f;
+    f.planes[0] = row[3] + row[0];  // left
+    f.planes[1] = row[3] - row[0];  // right
+    f.planes[2] = row[3] + row[1];  // bottom
+    f.planes[3] = row[3] - row[1];  // top
+    f.planes[4] = row[3] + row[2];  // near
+    f.planes[5] = row[3] - row[2];  // far
+    return f;
+}
+
+// Conservative test: a box is rejected only when it lies completely outside
+// one of the planes.
+bool boxInFrustum(Frustum const &f, glm::vec3 const &lo, glm::vec3 const &hi)
+{
+    for (int i = 0; i < 6; ++i) {
+        glm::vec4 const &p = f.planes[i];
+        // Corner furthest along the plane normal
+        glm::vec3 corner(p.x >= 0 ? hi.x : lo.x,
+                         p.y >= 0 ? hi.y : lo.y,
+                         p.z >= 0 ? hi.z : lo.z);
+        if (p.x*corner.x + p.y*corner.y + p.z*corner.z + p.w < 0) return false;
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer() :
+    current(0),
+    running(false),
+    elapsedMs(-1.0)
+{
+    queries[0] = queries[1] = 0;
+    pending[0] = pending[1] = false;
+}
+
+GpuTimer::~GpuTimer()
+{
+    if (queries[0] != 0) glDeleteQueries(2, queries);
+}
+
+void GpuTimer::begin()
+{
+    if (!GLEW_ARB_timer_query) return;
+    if (queries[0] == 0) glGenQueries(2, queries);
+
+    if (pending[current]) {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[current], GL_QUERY_RESULT_AVAILABLE, &available);
+        // Rather skip this frame than wait for the GPU to catch up
+        if (!available) return;
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &elapsedNs);
+        elapsedMs = elapsedNs / 1.0E6;
+        pending[current] = false;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    running = true;
+}
+
+void GpuTimer::end()
+{
+    if (!running) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[current] = true;
+    current = 1 - current;
+    running = false;
+}
@@ -0,0 +1,78 @@
+#include "LiveIntegrator.h"
+
+#include <algorithm>
+#include <chrono>
+
+LiveIntegrator::LiveIntegrator() :
+    ringLength(0),
+    stepRate(1),
+    frameSteps(0),
+    frameMs(0)
+{
+}
+
+void LiveIntegrator::reset(std::vector<OrbitCursor> const &systems,
+                           std::vector<glm::vec3> const &colors,
+                           unsigned int ringLength)
+{
+    cursors = systems;
+    systemColors = colors;
+    heads.assign(systems.size(), 0);
+    counts.assign(systems.size(), 0);
+    this->ringLength = std::max(ringLength, 2u);
+    stepRate = 1;
+    frameSteps = 0;
+    frameMs = 0;
+}
+
+// Integrates every system for this frame and writes the vertices produced
+// into positions, which holds slotSize() vertices per system.
+void LiveIntegrator::advance(ThreeBodySolver &solver, float *positions,
+                             double budgetMs)
+{
+    int numCursors = static_cast<int>(cursors.size());
+    if (numCursors == 0) return;
+
+    int stepsPerSystem = stepsPerFrame();
+    auto start = std::chrono::high_resolution_clock::now();
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < numCursors; ++i) {
+        float *slot = positions + 3 * static_cast<size_t>(i) * slotSize();
+        for (int s = 0; s < stepsPerSystem; ++s) {
+            glm::vec3 vertex;
+            if (!solver.stepOrbit(cursors[i], vertex)) continue;
+            unsigned int head = heads[i];
+            slot[3*head] = vertex[0];
+            slot[3*head + 1] = vertex[1];
+            slot[3*head + 2] = vertex[2];
+            if (head == 0) {
+                slot[3*ringLength] = vertex[0];
+                slot[3*ringLength + 1] = vertex[1];
+                slot[3*ringLength + 2] = vertex[2];
+            }
+            heads[i] = (head + 1) % ringLength;
+            counts[i] = std::min(counts[i] + 1, ringLength);
+        }
+    }
+    frameMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    frameSteps = static_cast<long long>(stepsPerSystem) * numCursors;
+
+    // Rescale the work to fit the budget next frame. The change is limited
+    // and smoothed so that a single slow frame does not collapse the rate.
+    double ratio = budgetMs / std::max(frameMs, 1E-3);
+    ratio = std::min(std::max(ratio, 0.5), 2.0);
+    stepRate = std::max(1.0, stepRate * (0.7 + 0.3 * ratio));
+}
+
+void LiveIntegrator::writeColors(float *colors) const
+{
+    for (size_t i = 0; i < systemColors.size(); ++i) {
+        float *slot = colors + 3 * i * slotSize();
+        for (unsigned int v = 0; v < slotSize(); ++v) {
+            slot[3*v] = systemColors[i].x;
+            slot[3*v + 1] = systemColors[i].y;
+            slot[3*v + 2] = systemColors[i].z;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#include "OrbitBufferPool.h"
+
+#include <utility>
+
+OrbitBufferPool::OrbitBufferPool()
+{
+}
+
+OrbitBuffers OrbitBufferPool::acquire(size_t numVertices)
+{
+    OrbitBuffers buffers;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!spare.empty()) {
+            buffers = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    buffers.states.reserve(numVertices);
+    buffers.line.reserve(3 * numVertices);
+    buffers.chunks.reserve(orbitChunkCount(numVertices));
+    return buffers;
+}
+
+void OrbitBufferPool::release(OrbitBuffers &&buffers)
+{
+    buffers.states.clear();
+    buffers.line.clear();
+    buffers.chunks.clear();
+    std::lock_guard<std::mutex> lock(poolMutex);
+    spare.push_back(std::move(buffers));
+}
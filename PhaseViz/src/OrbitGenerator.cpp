@@ -1,11 +1,15 @@
 #include "OrbitGenerator.h"
+#include "AllocationCounter.h"
+#include "ColumnExporter.h"
+#include "PagedOrbitFile.h"
+#include "Profiler.h"
 #include "ThreeBodySolver.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <iostream>
 
 ThreeBodySolver solver;
-std::vector<std::vector<ThreeBodySystem>> states;
 
 ThreeBodySystem randomSystem()
 {
@@ -48,32 +52,318 @@ ThreeBodySystem randomSystem()
 
 void OrbitGenerator::generateData()
 {
-    std::vector<glm::vec3> startingPoints;
-
     int numLines = 2;
+    int numPoints = 8000;
 
     std::cout << "Generating data..." << std::endl;
-	states.clear();
-	lines.clear();
+    long long firstAllocation = allocationCount();
+    // The new orbits are exported after the current ones
+    firstExportedOrbit += static_cast<long long>(states.size());
+    // Recycle the buffers of the previous orbits, which already have the
+    // capacity needed unless the new orbits are longer.
+    for (size_t i = 0; i < states.size(); ++i) {
+        pool.release({std::move(states[i]), std::move(lines[i]), std::move(chunks[i])});
+    }
+    states.resize(numLines);
+    lines.resize(numLines);
+    chunks.resize(numLines);
+    for (int i = 0; i < numLines; ++i) {
+        OrbitBuffers buffers = pool.acquire(numPoints);
+        states[i].swap(buffers.states);
+        lines[i].swap(buffers.line);
+        chunks[i].swap(buffers.chunks);
+    }
+    cursors.clear();
+    orbitColors.clear();
+    segmentIndex.clear();
+    covariance.clear();
 
-#pragma omp parallel
-#pragma omp for
+    // rand() is not thread safe, so starting points are drawn up front.
     for (int i = 0; i < numLines; ++i) {
-        auto tbs = randomSystem();
-        auto orbits = solver.computeOrbit(tbs, 8000);
-        states.push_back(orbits.first);
-        lines.push_back(orbits.second);
+        cursors.push_back(solver.startOrbit(randomSystem()));
+        orbitColors.push_back(randomVector(1.0));
+    }
+
+    extendData(numPoints);
+    if (firstAllocation >= 0) {
+        std::cout << "Allocations: " << allocationCount() - firstAllocation
+            << ", " << generation.allocations << " of them while integrating"
+            << std::endl;
+    }
+}
+
+// Returns true when the projection was updated and every vertex of every
+// orbit changed, not only the appended ones.
+bool OrbitGenerator::extendData(int numVertices)
+{
+    std::cout << "Extending " << cursors.size() << " orbits by "
+        << numVertices << " vertices..." << std::endl;
+    unsigned int firstNewVertex = orbitLength();
+    long long steps = 0;
+    long long firstAllocation = allocationCount();
+    double startUs = profiler.now();
+
+#pragma omp parallel
+    {
+        PhaseCovariance threadCovariance;
+#pragma omp for reduction(+:steps)
+        for (int i = 0; i < static_cast<int>(cursors.size()); ++i) {
+            // Grow the buffers up front when the pool did not size them, at
+            // least doubling them so that repeated extensions stay linear
+            size_t newSize = states[i].size() + numVertices;
+            if (states[i].capacity() < newSize) {
+                states[i].reserve(std::max(2*states[i].capacity(), newSize));
+            }
+            if (lines[i].capacity() < 3*newSize) {
+                lines[i].reserve(std::max(2*lines[i].capacity(), 3*newSize));
+            }
+            if (chunks[i].capacity() < orbitChunkCount(newSize)) {
+                chunks[i].reserve(std::max(2*chunks[i].capacity(), orbitChunkCount(newSize)));
+            }
+            steps += solver.extendOrbit(cursors[i], numVertices, states[i], lines[i]);
+            if (exporter) {
+                exporter->submit(firstExportedOrbit + i,
+                    std::vector<ThreeBodySystem>(states[i].begin() + firstNewVertex, states[i].end()),
+                    std::vector<float>(lines[i].begin() + 3*firstNewVertex, lines[i].end()));
+            }
+            updateChunks(i, firstNewVertex);
+            for (size_t v = firstNewVertex; v < states[i].size(); ++v) {
+                threadCovariance.add(states[i][v]);
+            }
+        }
+#pragma omp critical
+        covariance.merge(threadCovariance);
+    }
+
+    double durationUs = profiler.now() - startUs;
+    long long allocations = firstAllocation < 0 ? -1 : allocationCount() - firstAllocation;
+    profiler.complete("extendData", startUs, durationUs);
+    generation = {static_cast<int>(cursors.size()), steps, durationUs / 1000.0,
+        allocations};
+    profiler.counters("generation", {{"orbits", static_cast<double>(generation.orbits)},
+        {"steps", static_cast<double>(steps)}});
+    if (allocations >= 0) {
+        profiler.counters("allocations", {{"integration", static_cast<double>(allocations)}});
+    }
+
+    if (principalProjection) {
+        updateProjection();
+        return true;
+    }
+    segmentIndex.addSegments(lines, firstNewVertex);
+    return false;
+}
+
+// Starts exporting orbits as NumPy columns: the current orbits, then every
+// stretch of orbit integrated by generateData and extendData, which hand it
+// to the exporter's writer thread as soon as it is complete. Projected
+// coordinates are those in use when the vertices were integrated.
+bool OrbitGenerator::startExport(std::string const &outDir)
+{
+    if (exporter) return false;
+    std::cout << "Exporting orbits to " << outDir << std::endl;
+    exporter.reset(new ColumnExporter(outDir));
+    firstExportedOrbit = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        exporter->submit(static_cast<long long>(i), states[i], lines[i]);
+    }
+    return true;
+}
+
+// Waits for the queued orbits to be written and closes the export
+bool OrbitGenerator::stopExport()
+{
+    if (!exporter) return false;
+    bool ok = exporter->finish();
+    exporter.reset();
+    return ok;
+}
+
+// Bytes held by the orbit store: states, projected vertices and chunk bounds
+size_t OrbitGenerator::memoryUsage() const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < states.size(); ++i) {
+        bytes += states[i].capacity() * sizeof(ThreeBodySystem);
+        bytes += lines[i].capacity() * sizeof(float);
+        bytes += chunks[i].capacity() * sizeof(OrbitChunk);
     }
+    return bytes;
 }
 
+// Writes the current orbits as a paged orbit file, as read by --paged
+bool OrbitGenerator::writePaged(std::string const &path) const
+{
+    PagedOrbitWriter writer;
+    if (!writer.open(path)) return false;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        int orbit = writer.addOrbit(orbitColors[i]);
+        writer.addVertices(orbit, lines[i].data(), lines[i].size() / 3);
+        writer.endOrbit(orbit);
+    }
+    return writer.finish();
+}
+
+void OrbitGenerator::setPrincipalProjection(bool enabled)
+{
+    principalProjection = enabled;
+    updateProjection();
+}
+
+// Switches the solver to the principal components of all the states seen so
+// far, or to a new random projection, and reprojects the stored orbits.
+void OrbitGenerator::updateProjection()
+{
+    if (principalProjection && covariance.count() > PHASE_DIMS) {
+        double axes[3][PHASE_DIMS];
+        double center[PHASE_DIMS];
+        covariance.principalAxes(axes, center);
+        solver.setProjection(axes, center);
+        std::cout << "Principal components of " << covariance.count()
+            << " states" << std::endl;
+    } else {
+        solver.randomProjection();
+    }
+
+#pragma omp parallel for
+    for (int i = 0; i < static_cast<int>(states.size()); ++i) {
+        for (size_t v = 0; v < states[i].size(); ++v) {
+            glm::vec3 projected = solver.projectSystem(states[i][v]);
+            lines[i][3*v] = projected[0];
+            lines[i][3*v + 1] = projected[1];
+            lines[i][3*v + 2] = projected[2];
+        }
+        // Keep continuing orbits consistent with the new projection
+        if (!states[i].empty()) {
+            cursors[i].lastVert = solver.projectSystem(states[i].back());
+        }
+        cursors[i].lastOrbitPoint = solver.projectSystem(cursors[i].state);
+        updateChunks(i, 0);
+    }
+
+    segmentIndex.clear();
+    segmentIndex.addSegments(lines, 0);
+}
+
+// Recomputes the bounds of the chunks touched by vertices appended from
+// firstNewVertex onwards. Earlier chunks are left as they are.
+void OrbitGenerator::updateChunks(int orbit, unsigned int firstNewVertex)
+{
+    auto const &line = lines[orbit];
+    auto &orbitChunks = chunks[orbit];
+    unsigned int numVerts = static_cast<unsigned int>(line.size() / 3);
+    if (numVerts < 2) return;
+
+    unsigned int numChunks = static_cast<unsigned int>(orbitChunkCount(numVerts));
+    unsigned int firstChunk = firstNewVertex > 0 ? (firstNewVertex - 1) / ORBIT_CHUNK_SIZE : 0;
+    firstChunk = std::min(firstChunk, static_cast<unsigned int>(orbitChunks.size()));
+    orbitChunks.resize(numChunks);
+
+    for (unsigned int c = firstChunk; c < numChunks; ++c) {
+        unsigned int begin = c * ORBIT_CHUNK_SIZE;
+        unsigned int end = std::min(begin + ORBIT_CHUNK_SIZE + 1, numVerts);
+        glm::vec3 lo(line[3*begin], line[3*begin + 1], line[3*begin + 2]);
+        glm::vec3 hi = lo;
+        for (unsigned int v = begin + 1; v < end; ++v) {
+            glm::vec3 p(line[3*v], line[3*v + 1], line[3*v + 2]);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        orbitChunks[c] = {lo, hi};
+    }
+}
+
+// Starts numSystems new random systems for the live view, each keeping its
+// last ringLength vertices.
+void OrbitGenerator::startLive(int numSystems, unsigned int ringLength)
+{
+    std::cout << "Starting live integration of " << numSystems
+        << " systems..." << std::endl;
+    std::vector<OrbitCursor> liveCursors;
+    std::vector<glm::vec3> liveColors;
+    for (int i = 0; i < numSystems; ++i) {
+        liveCursors.push_back(solver.startOrbit(randomSystem()));
+        liveColors.push_back(randomVector(0.5) + glm::dvec3(0.5));
+    }
+    live.reset(liveCursors, liveColors, ringLength);
+}
+
+void OrbitGenerator::advanceLive(float *positions, double budgetMs)
+{
+    live.advance(solver, positions, budgetMs);
+}
+
+void OrbitGenerator::generateSection(SectionPlane const &plane, int numSystems,
+                                     int crossingsPerSystem)
+{
+    // Upper bound on the steps spent looking for crossings of a single
+    // system, for orbits that never come back to the plane.
+    const int maxSteps = 4000000;
+
+    std::cout << "Computing Poincare section of " << numSystems
+        << " systems..." << std::endl;
+
+    std::vector<OrbitCursor> sectionCursors;
+    std::vector<glm::vec3> systemColors;
+    for (int i = 0; i < numSystems; ++i) {
+        sectionCursors.push_back(solver.startOrbit(randomSystem()));
+        systemColors.push_back(randomVector(0.5) + glm::dvec3(0.5));
+    }
+
+    PoincareSection section(plane);
+    std::vector<std::vector<float>> systemPoints(numSystems);
+
+#pragma omp parallel
+    {
+        std::vector<ThreeBodySystem> crossings;
+        crossings.reserve(crossingsPerSystem);
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < numSystems; ++i) {
+            crossings.clear();
+            section.findCrossings(solver, sectionCursors[i], crossingsPerSystem,
+                                  maxSteps, crossings);
+            auto &points = systemPoints[i];
+            points.reserve(3*crossings.size());
+            for (auto const &crossing : crossings) {
+                glm::vec3 projected = solver.projectSystem(crossing);
+                points.push_back(projected[0]);
+                points.push_back(projected[1]);
+                points.push_back(projected[2]);
+            }
+        }
+    }
+
+    // Pack everything into a single cloud
+    std::vector<size_t> offsets(numSystems + 1, 0);
+    for (int i = 0; i < numSystems; ++i) {
+        offsets[i + 1] = offsets[i] + systemPoints[i].size();
+    }
+    sectionVertices.resize(offsets[numSystems]);
+    sectionVertColors.resize(offsets[numSystems]);
+
+#pragma omp parallel for
+    for (int i = 0; i < numSystems; ++i) {
+        std::copy(systemPoints[i].begin(), systemPoints[i].end(),
+                  sectionVertices.begin() + offsets[i]);
+        for (size_t j = offsets[i]; j < offsets[i + 1]; j += 3) {
+            sectionVertColors[j] = systemColors[i].x;
+            sectionVertColors[j + 1] = systemColors[i].y;
+            sectionVertColors[j + 2] = systemColors[i].z;
+        }
+    }
+
+    std::cout << "Section points: " << sectionVertices.size() / 3 << std::endl;
+}
 
 std::vector<std::vector<float>> OrbitGenerator::computeColors()
 {
     std::vector<std::vector<float>> colors;
-    for (auto curOrbit : states) {
+    for (size_t orbit = 0; orbit < states.size(); ++orbit) {
+        auto const &curOrbit = states[orbit];
         std::vector<float> orbitColor;
-		auto color = randomVector(1.0);
-        for (auto state : curOrbit) {
+		auto const &color = orbitColors[orbit];
+        orbitColor.reserve(3*curOrbit.size());
+        for (auto const &state : curOrbit) {
             // orbitColor.push_back(glm::length(state.body[coloredBody].velocity)*0.01);
             // orbitColor.push_back(state.body[coloredBody].position.x*state.body[coloredBody].position.x*10.0);
             // orbitColor.push_back(state.body[coloredBody].position.y*state.body[coloredBody].position.y*10.0);
@@ -0,0 +1,265 @@
+#include "PagedOrbitFile.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+const char pagedFileMagic[4] = {'P', 'V', 'P', 'G'};
+
+PagedOrbitWriter::PagedOrbitWriter() :
+    file(0),
+    failed(false),
+    dataOffset(0),
+    numOverviews(0)
+{
+}
+
+// An unfinished file is discarded, leaving any previous one at path intact
+PagedOrbitWriter::~PagedOrbitWriter()
+{
+    if (file) {
+        std::fclose(file);
+        std::remove(tmpPath.c_str());
+    }
+}
+
+// The file is written under a temporary name and moved to path by finish()
+bool PagedOrbitWriter::open(std::string const &path)
+{
+    this->path = path;
+    tmpPath = path + ".tmp";
+    file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        std::cout << "Unable to open " << tmpPath << std::endl;
+        return false;
+    }
+    // The header is written last, once the page count is known
+    PagedFileHeader header = {};
+    failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+    dataOffset = sizeof(header);
+    return !failed;
+}
+
+int PagedOrbitWriter::addOrbit(glm::vec3 const &color)
+{
+    OpenOrbit orbit;
+    for (unsigned int level = 0; level < PAGE_LEVELS; ++level) {
+        orbit.numPages[level] = 0;
+    }
+    orbit.numVertices = 0;
+    orbit.ended = false;
+    orbit.lo = glm::vec3(0);
+    orbit.hi = glm::vec3(0);
+    orbit.orbitLo = glm::vec3(0);
+    orbit.orbitHi = glm::vec3(0);
+    orbit.sampleStride = 1;
+    orbits.push_back(orbit);
+    colors.push_back(color);
+    return static_cast<int>(orbits.size()) - 1;
+}
+
+void PagedOrbitWriter::addVertices(int orbit, float const *vertices,
+                                   size_t numVertices)
+{
+    OpenOrbit &open = orbits[orbit];
+    for (size_t v = 0; v < numVertices; ++v) {
+        pushVertex(orbit, 0, vertices + 3*v);
+        if (open.numVertices % PAGE_LOD_STRIDE == 0) {
+            pushVertex(orbit, 1, vertices + 3*v);
+        }
+        if (open.numVertices % open.sampleStride == 0) {
+            pushSample(open, vertices + 3*v);
+        }
+        open.numVertices++;
+    }
+}
+
+void PagedOrbitWriter::pushVertex(int orbit, int level, float const *vertex)
+{
+    std::vector<float> &page = orbits[orbit].pages[level];
+    page.insert(page.end(), vertex, vertex + 3);
+    if (page.size() == 3 * PAGE_VERTICES) {
+        flushPage(orbit, level);
+        // The next page starts where this one ends
+        page.assign(vertex, vertex + 3);
+    }
+}
+
+// Samples are kept between OVERVIEW_VERTICES and 2*OVERVIEW_VERTICES by
+// dropping every other one and doubling the stride when they fill up, so
+// that they stay evenly spread over an orbit of unknown length.
+void PagedOrbitWriter::pushSample(OpenOrbit &open, float const *vertex)
+{
+    std::vector<float> &samples = open.samples;
+    samples.insert(samples.end(), vertex, vertex + 3);
+    if (samples.size() == 3 * 2 * OVERVIEW_VERTICES) {
+        for (size_t s = 1; s < OVERVIEW_VERTICES; ++s) {
+            std::copy(&samples[6*s], &samples[6*s + 3], &samples[3*s]);
+        }
+        samples.resize(3 * OVERVIEW_VERTICES);
+        open.sampleStride *= 2;
+    }
+}
+
+void PagedOrbitWriter::flushPage(int orbit, int level)
+{
+    OpenOrbit &open = orbits[orbit];
+    std::vector<float> const &page = open.pages[level];
+    std::uint32_t numVertices = static_cast<std::uint32_t>(page.size() / 3);
+
+    glm::vec3 lo(page[0], page[1], page[2]);
+    glm::vec3 hi = lo;
+    for (std::uint32_t v = 1; v < numVertices; ++v) {
+        glm::vec3 p(page[3*v], page[3*v + 1], page[3*v + 2]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    if (level == 0) {
+        bool first = open.numPages[0] % PAGE_LOD_STRIDE == 0;
+        open.lo = first ? lo : glm::min(open.lo, lo);
+        open.hi = first ? hi : glm::max(open.hi, hi);
+        bool firstPage = open.numPages[0] == 0;
+        open.orbitLo = firstPage ? lo : glm::min(open.orbitLo, lo);
+        open.orbitHi = firstPage ? hi : glm::max(open.orbitHi, hi);
+    } else {
+        lo = open.lo;
+        hi = open.hi;
+    }
+
+    PageInfo info = {static_cast<std::uint32_t>(orbit), static_cast<std::uint32_t>(level),
+        open.numPages[level], numVertices, 0, {lo.x, lo.y, lo.z}, {hi.x, hi.y, hi.z}};
+    writePage(info, page);
+    open.numPages[level]++;
+}
+
+// Writes the overview pages whose orbits are all ended, and with all set the
+// last, partially filled, one
+void PagedOrbitWriter::flushOverviews(bool all)
+{
+    while (true) {
+        size_t first = size_t(numOverviews) * OVERVIEW_ORBITS;
+        size_t end = std::min(first + OVERVIEW_ORBITS, orbits.size());
+        if (first >= end || (!all && end - first < OVERVIEW_ORBITS)) return;
+        for (size_t orbit = first; orbit < end; ++orbit) {
+            if (!orbits[orbit].ended) return;
+        }
+
+        std::vector<float> vertices;
+        vertices.reserve(3 * OVERVIEW_VERTICES * (end - first));
+        glm::vec3 lo(0), hi(0);
+        bool bounded = false;
+        for (size_t orbit = first; orbit < end; ++orbit) {
+            OpenOrbit &open = orbits[orbit];
+            vertices.insert(vertices.end(), open.samples.begin(), open.samples.end());
+            open.samples = std::vector<float>();
+            // Orbits without pages have no bounds
+            if (open.numPages[0] == 0) continue;
+            lo = bounded ? glm::min(lo, open.orbitLo) : open.orbitLo;
+            hi = bounded ? glm::max(hi, open.orbitHi) : open.orbitHi;
+            bounded = true;
+        }
+        PageInfo info = {static_cast<std::uint32_t>(first), OVERVIEW_LEVEL, numOverviews,
+            static_cast<std::uint32_t>(vertices.size() / 3), 0, {lo.x, lo.y, lo.z},
+            {hi.x, hi.y, hi.z}};
+        writePage(info, vertices);
+        numOverviews++;
+    }
+}
+
+// Appends the vertices to the file and their page to the directory
+void PagedOrbitWriter::writePage(PageInfo &info, std::vector<float> const &vertices)
+{
+    info.offset = dataOffset;
+    directory.push_back(info);
+    if (std::fwrite(&vertices[0], sizeof(float), vertices.size(), file) != vertices.size()) {
+        failed = true;
+    }
+    dataOffset += sizeof(float) * vertices.size();
+}
+
+// Flushes the partially filled pages of the orbit and releases them, and
+// makes its overview strip. No more vertices can be added to it.
+void PagedOrbitWriter::endOrbit(int orbit)
+{
+    OpenOrbit &open = orbits[orbit];
+    if (open.ended) return;
+    open.ended = true;
+    if (open.numVertices >= 2) {
+        if (open.pages[0].size() >= 6) flushPage(orbit, 0);
+        // Level 1 pages end at the last vertex even when it is not sampled
+        if ((open.numVertices - 1) % PAGE_LOD_STRIDE != 0) {
+            std::vector<float> const &last = open.pages[0];
+            pushVertex(orbit, 1, &last[last.size() - 3]);
+        }
+        if (open.pages[1].size() >= 6) flushPage(orbit, 1);
+    }
+
+    // The strip also ends at the last vertex, and is resampled to
+    // OVERVIEW_VERTICES vertices. It is left at the origin for an orbit
+    // without vertices.
+    if (open.numVertices > 0 && (open.numVertices - 1) % open.sampleStride != 0) {
+        std::vector<float> const &last = open.pages[0];
+        open.samples.insert(open.samples.end(), last.end() - 3, last.end());
+    }
+    std::vector<float> strip(3 * OVERVIEW_VERTICES, 0.0f);
+    size_t numSamples = open.samples.size() / 3;
+    for (size_t v = 0; numSamples > 0 && v < OVERVIEW_VERTICES; ++v) {
+        size_t s = (v * (numSamples - 1) + (OVERVIEW_VERTICES - 1) / 2) / (OVERVIEW_VERTICES - 1);
+        std::copy(&open.samples[3*s], &open.samples[3*s + 3], &strip[3*v]);
+    }
+    open.samples.swap(strip);
+
+    open.pages[0] = std::vector<float>();
+    open.pages[1] = std::vector<float>();
+    flushOverviews(false);
+}
+
+// Ends the orbits still open, writes the directory and header and moves the
+// file in place.
+bool PagedOrbitWriter::finish()
+{
+    if (!file) return false;
+    for (size_t orbit = 0; orbit < orbits.size(); ++orbit) {
+        endOrbit(static_cast<int>(orbit));
+    }
+    flushOverviews(true);
+
+    PagedFileHeader header = {};
+    std::memcpy(header.magic, pagedFileMagic, sizeof(header.magic));
+    header.version = pagedFileVersion;
+    header.pageVertices = PAGE_VERTICES;
+    header.lodStride = PAGE_LOD_STRIDE;
+    header.overviewVertices = OVERVIEW_VERTICES;
+    header.overviewOrbits = OVERVIEW_ORBITS;
+    header.numOrbits = orbits.size();
+    header.numPages = directory.size();
+    header.directoryOffset = dataOffset;
+
+    if (!directory.empty() &&
+        std::fwrite(&directory[0], sizeof(PageInfo), directory.size(), file) != directory.size()) {
+        failed = true;
+    }
+    for (auto const &color : colors) {
+        float rgb[3] = {color.x, color.y, color.z};
+        if (std::fwrite(rgb, sizeof(float), 3, file) != 3) failed = true;
+    }
+    if (std::fseek(file, 0, SEEK_SET) != 0 ||
+        std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        failed = true;
+    }
+    if (std::fclose(file) != 0) failed = true;
+    file = 0;
+    if (failed || !replaceFile(tmpPath, path)) {
+        std::remove(tmpPath.c_str());
+        failed = true;
+    }
+
+    if (failed) {
+        std::cout << "Unable to write " << path << std::endl;
+    } else {
+        std::cout << "Wrote " << directory.size() << " pages of " << orbits.size()
+            << " orbits to " << path << std::endl;
+    }
+    return !failed;
+}
@@ -0,0 +1,311 @@
+#include "PagedOrbitStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// fseek takes a long, which is 32 bits on Windows
+bool seekFile(std::FILE *f, std::uint64_t offset)
+{
+#if defined(_WIN32) || defined(WIN32)
+    return _fseeki64(f, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+glm::vec3 pageLo(PageInfo const &info)
+{
+    return glm::vec3(info.lo[0], info.lo[1], info.lo[2]);
+}
+
+glm::vec3 pageHi(PageInfo const &info)
+{
+    return glm::vec3(info.hi[0], info.hi[1], info.hi[2]);
+}
+
+// Approximate size on screen, in pixels, of the bounding sphere of a page
+float screenSize(PageInfo const &info, glm::vec3 const &eye, float pixelsPerRadian)
+{
+    glm::vec3 lo = pageLo(info);
+    glm::vec3 hi = pageHi(info);
+    float radius = 0.5f * glm::length(hi - lo);
+    float distance = glm::length(0.5f * (lo + hi) - eye) - radius;
+    if (distance < 1E-3f) return std::numeric_limits<float>::max();
+    return 2.0f * radius / distance * pixelsPerRadian;
+}
+
+}
+
+PagedOrbitStore::PagedOrbitStore() :
+    header(),
+    file(0),
+    stopping(false),
+    cacheLimit(0),
+    cacheSize(0),
+    numLoaded(0)
+{
+}
+
+PagedOrbitStore::~PagedOrbitStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        stopping = true;
+    }
+    pendingChanged.notify_all();
+    if (loader.joinable()) loader.join();
+    if (file) std::fclose(file);
+}
+
+bool PagedOrbitStore::open(std::string const &path, size_t cacheBytes)
+{
+    file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cout << "Unable to open " << path << std::endl;
+        return false;
+    }
+    if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+        std::memcmp(header.magic, pagedFileMagic, sizeof(header.magic)) != 0 ||
+        header.version != pagedFileVersion || header.pageVertices == 0 ||
+        header.lodStride == 0 || header.overviewVertices < 2 ||
+        header.overviewOrbits == 0) {
+        std::cout << path << " is not a paged orbit file" << std::endl;
+        return false;
+    }
+
+    directory.resize(header.numPages);
+    std::vector<float> rgb(3 * header.numOrbits);
+    if (!seekFile(file, header.directoryOffset) ||
+        (!directory.empty() &&
+         std::fread(&directory[0], sizeof(PageInfo), directory.size(), file) != directory.size()) ||
+        (!rgb.empty() && std::fread(&rgb[0], sizeof(float), rgb.size(), file) != rgb.size())) {
+        std::cout << "Unable to read the page directory of " << path << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < header.numOrbits; ++i) {
+        colors.push_back(glm::vec3(rgb[3*i], rgb[3*i + 1], rgb[3*i + 2]));
+    }
+
+    for (unsigned int level = 0; level < PAGE_LEVELS; ++level) {
+        levelPages[level].assign(header.numOrbits, std::vector<std::uint32_t>());
+    }
+    const std::uint32_t missing = std::numeric_limits<std::uint32_t>::max();
+    overviewPages.assign((header.numOrbits + header.overviewOrbits - 1) / header.overviewOrbits,
+        missing);
+    for (std::uint32_t id = 0; id < directory.size(); ++id) {
+        PageInfo const &info = directory[id];
+        bool overview = info.level == OVERVIEW_LEVEL;
+        if (info.orbit >= header.numOrbits || info.level > OVERVIEW_LEVEL ||
+            info.numVertices < 2 || info.numVertices > header.pageVertices ||
+            info.offset < sizeof(header) || info.offset > header.directoryOffset ||
+            (header.directoryOffset - info.offset) / (3 * sizeof(float)) < info.numVertices ||
+            (overview && (info.orbit != std::uint64_t(info.index) * header.overviewOrbits ||
+                info.numVertices != header.overviewVertices *
+                    std::min<std::uint64_t>(header.overviewOrbits, header.numOrbits - info.orbit)))) {
+            std::cout << "Bad page " << id << " in " << path << std::endl;
+            return false;
+        }
+        if (overview) {
+            overviewPages[info.index] = id;
+            continue;
+        }
+        auto &pages = levelPages[info.level][info.orbit];
+        if (pages.size() <= info.index) pages.resize(info.index + 1);
+        pages[info.index] = id;
+    }
+    if (std::count(overviewPages.begin(), overviewPages.end(), missing) > 0) {
+        std::cout << "Missing overview pages in " << path << std::endl;
+        return false;
+    }
+
+    cacheLimit = cacheBytes;
+    std::cout << "Opened " << path << ": " << header.numOrbits << " orbits, "
+        << header.numPages << " pages of at most " << header.pageVertices << " vertices"
+        << std::endl;
+    loader = std::thread(&PagedOrbitStore::loaderLoop, this);
+    return true;
+}
+
+size_t PagedOrbitStore::selectPages(Frustum const &frustum, glm::vec3 const &eye,
+    float pixelsPerRadian, float lodPixels, size_t maxPages,
+    std::vector<PageRequest> &wanted)
+{
+    auto larger = [](PageRequest const &a, PageRequest const &b) {
+        return a.priority > b.priority;
+    };
+    selection.clear();
+    for (std::uint32_t id : overviewPages) {
+        PageInfo const &info = directory[id];
+        if (!boxInFrustum(frustum, pageLo(info), pageHi(info))) continue;
+        selection.push_back({id, screenSize(info, eye, pixelsPerRadian), -1});
+    }
+    size_t leftOut = 0;
+    if (selection.size() > maxPages) {
+        std::sort(selection.begin(), selection.end(), larger);
+        leftOut = selection.size() - maxPages;
+        selection.resize(maxPages);
+    }
+
+    // A page is refined only if all its visible children fit
+    refinable.clear();
+    for (size_t i = 0; i < selection.size(); ++i) {
+        if (selection[i].priority > lodPixels) {
+            refinable.push_back(std::make_pair(selection[i].priority, static_cast<int>(i)));
+        }
+    }
+    std::make_heap(refinable.begin(), refinable.end());
+    while (!refinable.empty()) {
+        std::pop_heap(refinable.begin(), refinable.end());
+        int parent = refinable.back().second;
+        refinable.pop_back();
+        refine(directory[selection[parent].page], frustum, children);
+        if (children.empty() || selection.size() + children.size() > maxPages) continue;
+        for (std::uint32_t id : children) {
+            PageInfo const &info = directory[id];
+            float size = screenSize(info, eye, pixelsPerRadian);
+            if (info.level > 0 && size > lodPixels) {
+                refinable.push_back(std::make_pair(size, static_cast<int>(selection.size())));
+                std::push_heap(refinable.begin(), refinable.end());
+            }
+            selection.push_back({id, size, parent});
+        }
+    }
+
+    // Coarser levels load first. Parents are on a coarser level, so they
+    // stay ahead of their children.
+    loadOrder.resize(selection.size());
+    for (size_t i = 0; i < selection.size(); ++i) loadOrder[i] = static_cast<int>(i);
+    std::sort(loadOrder.begin(), loadOrder.end(), [this](int a, int b) {
+        std::uint32_t levelA = directory[selection[a].page].level;
+        std::uint32_t levelB = directory[selection[b].page].level;
+        if (levelA != levelB) return levelA > levelB;
+        return selection[a].priority > selection[b].priority;
+    });
+    positions.resize(selection.size());
+    wanted.clear();
+    for (int i : loadOrder) {
+        positions[i] = static_cast<int>(wanted.size());
+        PageRequest request = selection[i];
+        if (request.parent >= 0) request.parent = positions[request.parent];
+        wanted.push_back(request);
+    }
+    return leftOut;
+}
+
+// The visible pages of the next level covering the same vertices
+void PagedOrbitStore::refine(PageInfo const &info, Frustum const &frustum,
+                             std::vector<std::uint32_t> &children) const
+{
+    children.clear();
+    if (info.level == OVERVIEW_LEVEL) {
+        size_t end = std::min<size_t>(info.orbit + header.overviewOrbits, header.numOrbits);
+        for (size_t orbit = info.orbit; orbit < end; ++orbit) {
+            for (std::uint32_t id : levelPages[1][orbit]) {
+                PageInfo const &child = directory[id];
+                if (boxInFrustum(frustum, pageLo(child), pageHi(child))) children.push_back(id);
+            }
+        }
+    } else if (info.level == 1) {
+        auto const &fine = levelPages[0][info.orbit];
+        size_t end = std::min<size_t>((info.index + 1) * header.lodStride, fine.size());
+        for (size_t k = size_t(info.index) * header.lodStride; k < end; ++k) {
+            PageInfo const &child = directory[fine[k]];
+            if (boxInFrustum(frustum, pageLo(child), pageHi(child))) children.push_back(fine[k]);
+        }
+    }
+}
+
+void PagedOrbitStore::request(std::vector<PageRequest> const &wanted)
+{
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        // Kept in reverse, the loader takes from the back
+        pending.clear();
+        for (auto request = wanted.rbegin(); request != wanted.rend(); ++request) {
+            if (!failed.count(request->page)) pending.push_back(*request);
+        }
+    }
+    pendingChanged.notify_one();
+}
+
+PageData PagedOrbitStore::cachedPage(std::uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto entry = cache.find(id);
+    if (entry == cache.end()) return PageData();
+    lru.splice(lru.begin(), lru, entry->second.lruPos);
+    return entry->second.data;
+}
+
+bool PagedOrbitStore::pageFailed(std::uint32_t id) const
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return failed.count(id) > 0;
+}
+
+size_t PagedOrbitStore::cachedBytes() const
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cacheSize;
+}
+
+unsigned long long PagedOrbitStore::pagesLoaded() const
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return numLoaded;
+}
+
+void PagedOrbitStore::loaderLoop()
+{
+    std::unique_lock<std::mutex> lock(cacheMutex);
+    while (!stopping) {
+        while (!pending.empty() && cache.count(pending.back().page)) {
+            pending.pop_back();
+        }
+        if (pending.empty()) {
+            pendingChanged.wait(lock);
+            continue;
+        }
+        std::uint32_t id = pending.back().page;
+        pending.pop_back();
+
+        lock.unlock();
+        PageData data = readPage(id);
+        lock.lock();
+        if (!data) {
+            failed.insert(id);
+            continue;
+        }
+        if (cache.count(id)) continue;
+
+        lru.push_front(id);
+        cache[id] = {data, lru.begin()};
+        cacheSize += data->size() * sizeof(float);
+        numLoaded++;
+        // Evict the least recently used pages, never the one just loaded
+        while (cacheSize > cacheLimit && lru.size() > 1) {
+            auto evicted = cache.find(lru.back());
+            cacheSize -= evicted->second.data->size() * sizeof(float);
+            cache.erase(evicted);
+            lru.pop_back();
+        }
+    }
+}
+
+// Only called from the loader thread, which owns the file position
+PageData PagedOrbitStore::readPage(std::uint32_t id)
+{
+    PageInfo const &info = directory[id];
+    std::shared_ptr<std::vector<float>> data =
+        std::make_shared<std::vector<float>>(3 * info.numVertices);
+    if (!seekFile(file, info.offset) ||
+        std::fread(&(*data)[0], sizeof(float), data->size(), file) != data->size()) {
+        std::cout << "Unable to read page " << id << std::endl;
+        return PageData();
+    }
+    return data;
+}
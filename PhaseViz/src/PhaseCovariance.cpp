@@ -0,0 +1,136 @@
+#include "PhaseCovariance.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Cyclic Jacobi eigenvalue algorithm for the symmetric matrix a, which is
+// destroyed. On return the diagonal of a holds the eigenvalues and the
+// columns of v the eigenvectors.
+void jacobiEigen(double a[PHASE_DIMS][PHASE_DIMS], double v[PHASE_DIMS][PHASE_DIMS])
+{
+    const int n = PHASE_DIMS;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) v[i][j] = i == j ? 1.0 : 0.0;
+    }
+
+    for (int sweep = 0; sweep < 100; ++sweep) {
+        double offDiagonal = 0;
+        double diagonal = 0;
+        for (int i = 0; i < n; ++i) {
+            diagonal += a[i][i]*a[i][i];
+            for (int j = i + 1; j < n; ++j) offDiagonal += a[i][j]*a[i][j];
+        }
+        if (offDiagonal <= 1E-30 * diagonal) break;
+
+        for (int p = 0; p < n; ++p) {
+            for (int q = p + 1; q < n; ++q) {
+                if (a[p][q] == 0) continue;
+                double theta = (a[q][q] - a[p][p]) / (2*a[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta*theta + 1));
+                double c = 1 / std::sqrt(t*t + 1);
+                double s = t*c;
+                for (int k = 0; k < n; ++k) {
+                    double akp = a[k][p];
+                    double akq = a[k][q];
+                    a[k][p] = c*akp - s*akq;
+                    a[k][q] = s*akp + c*akq;
+                }
+                for (int k = 0; k < n; ++k) {
+                    double apk = a[p][k];
+                    double aqk = a[q][k];
+                    a[p][k] = c*apk - s*aqk;
+                    a[q][k] = s*apk + c*aqk;
+                }
+                for (int k = 0; k < n; ++k) {
+                    double vkp = v[k][p];
+                    double vkq = v[k][q];
+                    v[k][p] = c*vkp - s*vkq;
+                    v[k][q] = s*vkp + c*vkq;
+                }
+            }
+        }
+    }
+}
+
+}
+
+PhaseCovariance::PhaseCovariance()
+{
+    clear();
+}
+
+void PhaseCovariance::clear()
+{
+    n = 0;
+    std::fill(mean, mean + PHASE_DIMS, 0.0);
+    std::fill(&m2[0][0], &m2[0][0] + PHASE_DIMS*PHASE_DIMS, 0.0);
+}
+
+void PhaseCovariance::add(ThreeBodySystem const &s)
+{
+    double x[PHASE_DIMS];
+    toPhaseVector(s, x);
+
+    n++;
+    double delta[PHASE_DIMS];
+    for (int i = 0; i < PHASE_DIMS; ++i) {
+        delta[i] = x[i] - mean[i];
+        mean[i] += delta[i] / n;
+    }
+    for (int i = 0; i < PHASE_DIMS; ++i) {
+        double delta2 = x[i] - mean[i];
+        for (int j = 0; j < PHASE_DIMS; ++j) {
+            m2[j][i] += delta[j]*delta2;
+        }
+    }
+}
+
+// Pairwise combination of Chan, Golub and LeVeque
+void PhaseCovariance::merge(PhaseCovariance const &other)
+{
+    if (other.n == 0) return;
+    if (n == 0) {
+        *this = other;
+        return;
+    }
+
+    long long total = n + other.n;
+    double weight = static_cast<double>(n) * other.n / total;
+    double delta[PHASE_DIMS];
+    for (int i = 0; i < PHASE_DIMS; ++i) {
+        delta[i] = other.mean[i] - mean[i];
+        mean[i] += delta[i] * other.n / total;
+    }
+    for (int i = 0; i < PHASE_DIMS; ++i) {
+        for (int j = 0; j < PHASE_DIMS; ++j) {
+            m2[i][j] += other.m2[i][j] + delta[i]*delta[j]*weight;
+        }
+    }
+    n = total;
+}
+
+// The three eigenvectors of the covariance with largest eigenvalues, and the
+// mean state around which they are taken.
+void PhaseCovariance::principalAxes(double axes[3][PHASE_DIMS], double center[PHASE_DIMS]) const
+{
+    double a[PHASE_DIMS][PHASE_DIMS];
+    double v[PHASE_DIMS][PHASE_DIMS];
+    for (int i = 0; i < PHASE_DIMS; ++i) {
+        for (int j = 0; j < PHASE_DIMS; ++j) {
+            // Symmetrize away rounding differences between m2[i][j] and m2[j][i]
+            a[i][j] = 0.5*(m2[i][j] + m2[j][i]) / std::max(n - 1, 1LL);
+        }
+    }
+    jacobiEigen(a, v);
+
+    int order[PHASE_DIMS];
+    for (int i = 0; i < PHASE_DIMS; ++i) order[i] = i;
+    std::sort(order, order + PHASE_DIMS, [&](int i, int j) { return a[i][i] > a[j][j]; });
+
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int i = 0; i < PHASE_DIMS; ++i) axes[axis][i] = v[i][order[axis]];
+    }
+    std::copy(mean, mean + PHASE_DIMS, center);
+}
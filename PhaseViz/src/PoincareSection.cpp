@@ -0,0 +1,156 @@
+#include "PoincareSection.h"
+
+#include <cmath>
+
+namespace {
+
+// Cubic Hermite basis on [0, 1]
+void hermiteBasis(double t, double &h00, double &h10, double &h01, double &h11)
+{
+    double t2 = t*t;
+    double t3 = t2*t;
+    h00 = 2*t3 - 3*t2 + 1;
+    h10 = t3 - 2*t2 + t;
+    h01 = -2*t3 + 3*t2;
+    h11 = t3 - t2;
+}
+
+glm::dvec3 const &bodyAccel(SystemAccels const &a, int body)
+{
+    return body == 0 ? a.a1 : (body == 1 ? a.a2 : a.a3);
+}
+
+// Dense output of a step of size h going from s0 to s1. Positions use the
+// velocities as derivatives and velocities use the accelerations.
+ThreeBodySystem interpolate(ThreeBodySystem const &s0, SystemAccels const &a0,
+                            ThreeBodySystem const &s1, SystemAccels const &a1,
+                            double h, double t)
+{
+    double h00, h10, h01, h11;
+    hermiteBasis(t, h00, h10, h01, h11);
+
+    ThreeBodySystem r;
+    for (int b = 0; b < 3; ++b) {
+        r.body[b].position = h00*s0.body[b].position + (h10*h)*s0.body[b].velocity +
+            h01*s1.body[b].position + (h11*h)*s1.body[b].velocity;
+        r.body[b].velocity = h00*s0.body[b].velocity + (h10*h)*bodyAccel(a0, b) +
+            h01*s1.body[b].velocity + (h11*h)*bodyAccel(a1, b);
+    }
+    return r;
+}
+
+}
+
+SectionPlane axisSection(int component, double offset, int direction)
+{
+    SectionPlane plane = {};
+    plane.normal[component] = 1.0;
+    plane.offset = offset;
+    plane.direction = direction;
+    return plane;
+}
+
+PoincareSection::PoincareSection(SectionPlane const &sectionPlane) :
+    plane(sectionPlane)
+{
+}
+
+// Integrates from the cursor until numCrossings crossings of the plane have
+// been appended to crossings, or maxSteps steps have been taken. Returns the
+// number of steps taken.
+int PoincareSection::findCrossings(ThreeBodySolver &solver, OrbitCursor &cursor,
+                                   int numCrossings, int maxSteps,
+                                   std::vector<ThreeBodySystem> &crossings) const
+{
+    ThreeBodySystem prev = cursor.state;
+    SystemAccels prevAccels = computeAccelerations(prev);
+    double prevG = planeValue(prev);
+    double prevRate = planeRate(prev, prevAccels);
+
+    int numSteps = 0;
+    int numFound = 0;
+    while (numFound < numCrossings && numSteps < maxSteps) {
+        double h;
+        solver.advanceAdaptive(cursor, h);
+        cursor.numSteps++;
+        numSteps++;
+
+        ThreeBodySystem const &cur = cursor.state;
+        SystemAccels curAccels = computeAccelerations(cur);
+        double curG = planeValue(cur);
+        double curRate = planeRate(cur, curAccels);
+
+        bool up = prevG < 0 && curG >= 0;
+        bool down = prevG > 0 && curG <= 0;
+        if ((up && plane.direction >= 0) || (down && plane.direction <= 0)) {
+            double t = findRoot(prevG, prevRate, curG, curRate, h);
+            crossings.push_back(interpolate(prev, prevAccels, cur, curAccels, h, t));
+            numFound++;
+        }
+
+        prev = cur;
+        prevAccels = curAccels;
+        prevG = curG;
+        prevRate = curRate;
+    }
+    return numSteps;
+}
+
+double PoincareSection::planeValue(ThreeBodySystem const &s) const
+{
+    double x[PHASE_DIMS];
+    toPhaseVector(s, x);
+    double g = -plane.offset;
+    for (int i = 0; i < PHASE_DIMS; ++i) {
+        g += plane.normal[i]*x[i];
+    }
+    return g;
+}
+
+// Time derivative of planeValue along the trajectory
+double PoincareSection::planeRate(ThreeBodySystem const &s, SystemAccels const &a) const
+{
+    double rate = 0;
+    for (int b = 0; b < 3; ++b) {
+        for (int c = 0; c < 3; ++c) {
+            rate += plane.normal[3*b + c]*s.body[b].velocity[c];
+            rate += plane.normal[9 + 3*b + c]*bodyAccel(a, b)[c];
+        }
+    }
+    return rate;
+}
+
+// The plane function is linear, so along the Hermite dense output it is the
+// scalar cubic with values g0, g1 and slopes d0, d1 at the ends of the step.
+// The bracketed root is refined with the Illinois variant of regula falsi.
+double PoincareSection::findRoot(double g0, double d0, double g1, double d1, double h) const
+{
+    auto g = [&](double t) {
+        double h00, h10, h01, h11;
+        hermiteBasis(t, h00, h10, h01, h11);
+        return h00*g0 + h01*g1 + h*(h10*d0 + h11*d1);
+    };
+
+    double a = 0, b = 1;
+    double ga = g0, gb = g1;
+    int side = 0;
+    double t = 1;
+    for (int iter = 0; iter < 60; ++iter) {
+        if (gb == ga) break;
+        t = (a*gb - b*ga)/(gb - ga);
+        double gt = g(t);
+        if (std::abs(gt) < 1E-14 || b - a < 1E-12) break;
+        if (gt*gb > 0) {
+            b = t;
+            gb = gt;
+            if (side == -1) ga *= 0.5;
+            side = -1;
+        } else {
+            a = t;
+            ga = gt;
+            if (side == 1) gb *= 0.5;
+            side = 1;
+        }
+    }
+    return t;
+}
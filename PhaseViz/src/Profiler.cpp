@@ -0,0 +1,131 @@
+#include "Profiler.h"
+
+#include <iostream>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+Profiler profiler;
+
+namespace {
+
+int threadId()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+}
+
+Profiler::Profiler() :
+    origin(std::chrono::high_resolution_clock::now()),
+    traceFile(0),
+    firstEvent(true)
+{
+}
+
+Profiler::~Profiler()
+{
+    stopTrace();
+}
+
+bool Profiler::startTrace(std::string const &path)
+{
+    stopTrace();
+    std::lock_guard<std::mutex> lock(traceMutex);
+    traceFile = std::fopen(path.c_str(), "w");
+    if (!traceFile) {
+        std::cout << "Unable to open " << path << std::endl;
+        return false;
+    }
+    std::fputs("[\n", traceFile);
+    firstEvent = true;
+    std::cout << "Tracing to " << path << std::endl;
+    return true;
+}
+
+void Profiler::stopTrace()
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (!traceFile) return;
+    std::fputs("\n]\n", traceFile);
+    std::fclose(traceFile);
+    traceFile = 0;
+    std::cout << "Trace closed" << std::endl;
+}
+
+double Profiler::now() const
+{
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::high_resolution_clock::now() - origin).count();
+}
+
+void Profiler::complete(char const *name, double startUs, double durationUs,
+    std::initializer_list<std::pair<char const *, double>> args)
+{
+    if (!tracing()) return;
+    std::ostringstream event;
+    event << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+        << threadId() << ",\"ts\":" << std::fixed << startUs
+        << ",\"dur\":" << durationUs;
+    if (args.size() > 0) writeArgs(event, args);
+    event << "}";
+    writeEvent(event.str());
+}
+
+void Profiler::counters(char const *name,
+    std::initializer_list<std::pair<char const *, double>> values)
+{
+    if (!tracing()) return;
+    std::ostringstream event;
+    event << "{\"name\":\"" << name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":"
+        << threadId() << ",\"ts\":" << std::fixed << now();
+    writeArgs(event, values);
+    event << "}";
+    writeEvent(event.str());
+}
+
+void Profiler::writeArgs(std::ostream &event,
+    std::initializer_list<std::pair<char const *, double>> args)
+{
+    event << ",\"args\":{";
+    bool first = true;
+    for (auto const &arg : args) {
+        event << (first ? "" : ",") << "\"" << arg.first << "\":" << arg.second;
+        first = false;
+    }
+    event << "}";
+}
+
+void Profiler::writeEvent(std::string const &event)
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (!traceFile) return;
+    if (!firstEvent) std::fputs(",\n", traceFile);
+    std::fputs(event.c_str(), traceFile);
+    firstEvent = false;
+}
+
+ScopedTimer::ScopedTimer(char const *name, double *elapsedMs) :
+    name(name),
+    elapsedMs(elapsedMs),
+    startUs(profiler.now()),
+    bytes(-1)
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    double durationUs = profiler.now() - startUs;
+    if (elapsedMs) *elapsedMs = durationUs / 1000.0;
+    if (bytes >= 0) {
+        profiler.complete(name, startUs, durationUs, {{"bytes", bytes}});
+    } else {
+        profiler.complete(name, startUs, durationUs);
+    }
+}
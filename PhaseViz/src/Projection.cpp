@@ -28,33 +28,43 @@ void Projection::createMatrix()
     double sqY = 1.0 / sqrt(sumSquaredY);
     double sqZ = 1.0 / sqrt(sumSquaredZ);
 
+    double rows[3][PHASE_DIMS];
+    double center[PHASE_DIMS] = {};
     for (int i = 0; i < 18; ++i) {
-        rowX[i] *= sqX;
-        rowY[i] *= sqY;
-        rowZ[i] *= sqZ;
+        rows[0][i] = rowX[i] * sqX;
+        rows[1][i] = rowY[i] * sqY;
+        rows[2][i] = rowZ[i] * sqZ;
     }
+    setRows(rows, center);
+}
 
+// Sets the projection to x -> rows * (x - center)
+void Projection::setRows(double const rows[3][PHASE_DIMS], double const center[PHASE_DIMS])
+{
     for (int body = 0; body < 3; body++) {
         for (int column = 0; column < 3; column++) {
-            positions[body][column][0] = rowX[3*body + column];
-            positions[body][column][1] = rowY[3*body + column];
-            positions[body][column][2] = rowZ[3*body + column];
+            positions[body][column][0] = rows[0][3*body + column];
+            positions[body][column][1] = rows[1][3*body + column];
+            positions[body][column][2] = rows[2][3*body + column];
         }
     }
     for (int body = 0; body < 3; body++) {
         for (int column = 0; column < 3; column++) {
-            velocities[body][column][0] = rowX[9 + 3*body + column];
-            velocities[body][column][1] = rowY[9 + 3*body + column];
-            velocities[body][column][2] = rowZ[9 + 3*body + column];
+            velocities[body][column][0] = rows[0][9 + 3*body + column];
+            velocities[body][column][1] = rows[1][9 + 3*body + column];
+            velocities[body][column][2] = rows[2][9 + 3*body + column];
         }
     }
+    for (int axis = 0; axis < 3; axis++) {
+        offset[axis] = std::inner_product(rows[axis], rows[axis] + PHASE_DIMS, center, 0.0);
+    }
 }
 
 glm::dvec3 Projection::phaseSpaceToVizSpace(ThreeBodySystem const &s)
 {
     glm::dvec3 r = positions[0]*s.body[0].position + positions[1]*s.body[1].position + positions[2]*s.body[2].position +
         velocities[0]*s.body[0].velocity + velocities[1]*s.body[1].velocity + velocities[2]*s.body[2].velocity;
-    return r;
+    return r - offset;
 }
 
 glm::mat3x3 Projection::projMatrix(Axis selectedAxis)
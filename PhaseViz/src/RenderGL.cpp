@@ -7,94 +7,23 @@ const double M_PI = 3.141592653589793238462643;
 #endif
 
 #include "RenderGL.h"
+#include "Frustum.h"
 #include "OrbitGenerator.h"
+#include "Profiler.h"
+#include "ShaderLoader.h"
 #include "utils.h"
 
 
+#include <algorithm>
 #include <chrono>
 #include <GL/glew.h>
 #include <GL/glut.h>
-#include <fstream>
 #include <glm/ext.hpp>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <memory>
 
-GLuint loadAndCompile(std::string const &shaderFile, GLenum shader_type)
-{
-    GLuint shaderID = glCreateShader(shader_type);
-
-    // Read the Shader code from the file
-    std::string shaderCode;
-    std::ifstream shaderStream(shaderFile, std::ios::in);
-    if (shaderStream.is_open()) {
-        std::stringstream sstr;
-        sstr << shaderStream.rdbuf();
-        shaderCode = sstr.str();
-        shaderStream.close();
-    } else {
-        std::cout << "Unable to open " << shaderFile << std::endl;
-        return 0;
-    }
-
-    GLint result = GL_FALSE;
-    int infoLogLength;
-
-    // Compile Shader
-    std::cout << "Compiling shader : " << shaderFile << std::endl;
-    char const *sourcePointer = shaderCode.c_str();
-    glShaderSource(shaderID, 1, &sourcePointer, NULL);
-    glCompileShader(shaderID);
-
-    // Check Shader
-    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
-    if (infoLogLength > 0) {
-        std::vector<char> shaderErrorMessage(infoLogLength + 1);
-        glGetShaderInfoLog(shaderID, infoLogLength, NULL,
-            &shaderErrorMessage[0]);
-        std::cout << &shaderErrorMessage[0] << std::endl;
-    }
-
-    return shaderID;
-}
-
-GLuint loadShaders(std::string const &vertexFilePath,
-    std::string const &fragmentFilePath)
-{
-    // Create the shaders
-    GLuint vertexShaderID = loadAndCompile(vertexFilePath, GL_VERTEX_SHADER);
-    GLuint fragmentShaderID = loadAndCompile(fragmentFilePath, GL_FRAGMENT_SHADER);
-
-    // Link the program
-    std::cout << "Linking program" << std::endl;
-    GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    glAttachShader(programID, fragmentShaderID);
-    glLinkProgram(programID);
-
-    // Check the program
-    GLint result = GL_FALSE;
-    int infoLogLength;
-    glGetProgramiv(programID, GL_LINK_STATUS, &result);
-    glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
-    if (infoLogLength > 0) {
-        std::vector<char> programErrorMessage(infoLogLength + 1);
-        glGetProgramInfoLog(programID, infoLogLength, NULL,
-            &programErrorMessage[0]);
-        std::cout << &programErrorMessage[0] << std::endl;
-    }
-
-    glDetachShader(programID, vertexShaderID);
-    glDetachShader(programID, fragmentShaderID);
-
-    glDeleteShader(vertexShaderID);
-    glDeleteShader(fragmentShaderID);
-
-    return programID;
-}
-
 int coloredBody = 0;
 
 std::shared_ptr<RenderGL> phaseRender;
@@ -103,14 +32,24 @@ OrbitGenerator orbGen;
 
 void initGLRendering(int argc, char **argv)
 {
+    auto start = std::chrono::high_resolution_clock::now();
     glutInit(&argc, argv);
+    std::string pagedPath;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--paged") pagedPath = argv[i + 1];
+    }
     phaseRender = std::make_shared<RenderGL>();
-    orbGen.generateData();
+    if (pagedPath.empty() || !phaseRender->openPaged(pagedPath)) {
+        orbGen.generateData();
 
-    auto colors = orbGen.computeColors();
-    std::cout << "Sending data to renderer." << std::endl;
-    phaseRender->updateData(orbGen.orbitLines(), colors);
+        auto colors = orbGen.computeColors();
+        std::cout << "Sending data to renderer." << std::endl;
+        phaseRender->updateData(orbGen.orbitLines(), colors);
+    }
 //    phaseRender->setProjAxes(solver.projectionAxes(drawnAxis));
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Startup took " << duration << " ms" << std::endl;
 }
 
 void cdisplay(void)
@@ -138,12 +77,54 @@ void ckeyPressed(unsigned char key, int a, int b)
     phaseRender->keyPressed(key, a, b);
 }
 
+void cupdate(int)
+{
+    phaseRender->update();
+}
+
+// Live view frame rate, and the part of every frame spent integrating. The
+// rest is left for the upload, the drawing and the event handling.
+const double LIVE_FRAME_MS = 1000.0 / 60.0;
+const double LIVE_BUDGET_MS = 8.0;
+const int LIVE_SYSTEMS = 64;
+const unsigned int LIVE_RING_LENGTH = 2000;
+
+// Memory budgets of the paged view: 1024 slots of PAGE_VERTICES vertices are
+// 192 MB of VRAM. Pages covering more than PAGE_LOD_PIXELS on screen are
+// replaced by their finer pages while those fit in the slots.
+const unsigned int PAGE_POOL_SLOTS = 1024;
+const size_t PAGE_CACHE_BYTES = size_t(512) * 1024 * 1024;
+const unsigned int PAGE_UPLOADS_PER_FRAME = 8;
+const float PAGE_LOD_PIXELS = 256.0f;
+
 RenderGL::RenderGL() :
     numPoints(0),
     numLines(0),
+    lineLength(0),
+    lineCapacity(0),
     vboId(0),
-    iboId(0),
+    sectionVboId(0),
+    numSectionPoints(0),
+    drawMode(DRAW_ORBITS),
+    numDrawnVertices(0),
+    densityTexId(0),
+    densityMvp(glm::mat4(1.0f)),
+    densityVertices(0),
     shaderId(0),
+    liveVboId(0),
+    liveMapped(0),
+    liveFence(0),
+    liveTimerArmed(false),
+    nextFrameTime(0),
+    pagePoolVboId(0),
+    pagesLeftOut(0),
+    pagedFrame(0),
+    showHud(true),
+    lastFrameStart(0),
+    frameIntervalMs(0),
+    frameCpuMs(0),
+    lastUploadBytes(0),
+    lastUploadMs(0),
     eye(-0.3, 0.5, 5.0),
     modelMat(glm::mat4(1.0f)),
     modelMatInv(glm::mat4(1.0f)),
@@ -173,8 +154,8 @@ RenderGL::RenderGL() :
     glEnable(GL_DEPTH_TEST);
     glDepthRange(0.1, 2000.0);
 
-    shaderId = loadShaders("rotate.vert", "phase.frag");
-    //   shaderId = loadShaders("plain.vert", "plain.frag");
+    shaderId = loadProgram("rotate.vert", "phase.frag");
+    //   shaderId = loadProgram("plain.vert", "plain.frag");
 
     glutDisplayFunc(cdisplay);
     //  glutIdleFunc(updateRender);
@@ -187,7 +168,11 @@ RenderGL::RenderGL() :
 RenderGL::~RenderGL()
 {
     glDeleteBuffers(1, &vboId);
-    glDeleteBuffers(1, &iboId);
+    glDeleteBuffers(1, &sectionVboId);
+    glDeleteTextures(1, &densityTexId);
+    if (liveFence) glDeleteSync(liveFence);
+    glDeleteBuffers(1, &liveVboId);
+    glDeleteBuffers(1, &pagePoolVboId);
     glDeleteProgram(shaderId);
 }
 
@@ -215,11 +200,21 @@ void RenderGL::mouseDrag(int x, int y)
 
 void RenderGL::mouseClick(int button, int state, int x, int y)
 {
-    if (state == GLUT_UP) return;  // Disregard redundant GLUT_UP events
+    if (state == GLUT_UP) {
+        // The density map waits for the end of a drag to catch up
+        if (button == 0 && dragging) {
+            dragging = false;
+            if (drawMode == DRAW_DENSITY) glutPostRedisplay();
+        }
+        return;
+    }
     if (button == 0) {
         // Drag started.
         dragPrevX = x;
         dragPrevY = y;
+        dragging = true;
+    } else if (button == 2) {
+        pickOrbit(x, y);
     } else if (button == 3) {
         // Wheel reports as button 3(scroll up) and button 4(scroll down)
         moveForward();
@@ -228,6 +223,52 @@ void RenderGL::mouseClick(int button, int state, int x, int y)
     }
 }
 
+// Casts a ray through the clicked pixel and reports the phase state of the
+// orbit vertex under it.
+void RenderGL::pickOrbit(int x, int y)
+{
+    float width = static_cast<float>(glutGet(GLUT_WINDOW_WIDTH));
+    float height = static_cast<float>(glutGet(GLUT_WINDOW_HEIGHT));
+    float ndcX = 2.0f * x / width - 1.0f;
+    float ndcY = 1.0f - 2.0f * y / height;
+
+    glm::mat4 invMvp = glm::inverse(modelViewProjMat);
+    auto unproject = [&](float px, float py, float pz) {
+        glm::vec4 p = invMvp * glm::vec4(px, py, pz, 1.0f);
+        return glm::vec3(p) / p.w;
+    };
+    glm::vec3 origin = unproject(ndcX, ndcY, -1.0f);
+    glm::vec3 dir = glm::normalize(unproject(ndcX, ndcY, 1.0f) - origin);
+
+    // Accept segments within a few pixels, measured at the depth of the
+    // center of the phase space.
+    glm::vec4 center = modelViewProjMat * glm::vec4(0, 0, 0, 1);
+    float centerDepth = center.z / center.w;
+    float radius = glm::length(unproject(ndcX + 8.0f / width, ndcY, centerDepth) -
+                               unproject(ndcX, ndcY, centerDepth));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    PickResult picked;
+    bool found = orbGen.pick(origin, dir, radius, picked);
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    if (!found) {
+        std::cout << "Nothing picked (" << duration << " us)" << std::endl;
+        return;
+    }
+    std::cout << "Picked orbit " << picked.orbit << ", vertex " << picked.vertex
+        << " (" << duration << " us)" << std::endl;
+    ThreeBodySystem const &tbs = orbGen.orbitState(picked.orbit, picked.vertex);
+    for (int body = 0; body < 3; ++body) {
+        glm::dvec3 const &pos = tbs.body[body].position;
+        glm::dvec3 const &vel = tbs.body[body].velocity;
+        std::cout << "  body " << body << std::setprecision(6)
+            << "  pos=[" << pos.x << ", " << pos.y << ", " << pos.z << "]"
+            << "  vel=[" << vel.x << ", " << vel.y << ", " << vel.z << "]" << std::endl;
+    }
+}
+
 void RenderGL::keyPressed(unsigned char key, int a, int b)
 {
     if (key == 'r') {
@@ -236,7 +277,56 @@ void RenderGL::keyPressed(unsigned char key, int a, int b)
 		std::cout << "Sending data to renderer." << std::endl;
 		phaseRender->updateData(orbGen.orbitLines(), colors);
 	}
-    else if (key == 'w') {
+    else if (key == 'e') {
+        unsigned int prevLength = orbGen.orbitLength();
+        bool reprojected = orbGen.extendData(2000);
+        auto colors = orbGen.computeColors();
+        if (reprojected) {
+            std::cout << "Sending data to renderer." << std::endl;
+            phaseRender->updateData(orbGen.orbitLines(), colors);
+        } else {
+            std::cout << "Sending new vertices to renderer." << std::endl;
+            phaseRender->appendData(orbGen.orbitLines(), colors, prevLength);
+        }
+    } else if (key == 'x') {
+        // Toggle streaming the orbits to ./export as they are integrated
+        if (!orbGen.exporting()) {
+            orbGen.startExport("export");
+        } else if (orbGen.stopExport()) {
+            orbGen.writePaged("export/orbits.pvpg");
+        }
+    } else if (key == 'm') {
+        // Toggle between random and principal components projections
+        orbGen.setPrincipalProjection(!orbGen.usesPrincipalProjection());
+        auto colors = orbGen.computeColors();
+        std::cout << "Sending data to renderer." << std::endl;
+        phaseRender->updateData(orbGen.orbitLines(), colors);
+    } else if (key == 'p') {
+        // Crossings of body 0 through the x=0 plane, going right
+        orbGen.generateSection(axisSection(0, 0.0, 1), 1000, 200);
+        std::cout << "Sending section to renderer." << std::endl;
+        updateSection(orbGen.sectionPoints(), orbGen.sectionColors());
+        setDrawMode(DRAW_SECTION);
+    } else if (key == 'l') {
+        // Start new live systems, or leave the live view
+        if (drawMode == DRAW_LIVE) {
+            setDrawMode(DRAW_ORBITS);
+        } else {
+            startLive();
+            setDrawMode(DRAW_LIVE);
+        }
+    } else if (key == 'h') {
+        showHud = !showHud;
+        glutPostRedisplay();
+    } else if (key == 't') {
+        if (profiler.tracing()) {
+            profiler.stopTrace();
+        } else {
+            profiler.startTrace("phaseviz_trace.json");
+        }
+    } else if (key == 'v') {
+        setDrawMode((DrawMode)((drawMode + 1)%DRAW_MODE_NELEMS));
+    } else if (key == 'w') {
         moveForward();
     } else if (key == 's') {
         moveBackward();
@@ -250,12 +340,41 @@ void RenderGL::keyPressed(unsigned char key, int a, int b)
     }
 }
 
+// Advances the live systems by one frame. Runs from a GLUT timer paced at
+// LIVE_FRAME_MS while the live view is shown.
 void RenderGL::update()
 {
-    // Update vertex positions
-    //solv3.advanceStep(0.1);
-
+    liveTimerArmed = false;
+    if (drawMode != DRAW_LIVE) return;
+
+    double now = glutGet(GLUT_ELAPSED_TIME);
+    if (liveMapped) {
+        // The GPU may still be drawing from the rings of the previous frame
+        if (liveFence) {
+            glClientWaitSync(liveFence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+            glDeleteSync(liveFence);
+            liveFence = 0;
+        }
+        orbGen.advanceLive(liveMapped, LIVE_BUDGET_MS);
+    } else if (liveVboId != 0) {
+        orbGen.advanceLive(&liveStaging[0], LIVE_BUDGET_MS);
+        ScopedTimer timer("uploadLive", &lastUploadMs);
+        lastUploadBytes = sizeof(float) * liveStaging.size() / 2;
+        timer.setBytes(lastUploadBytes);
+        glBindBuffer(GL_ARRAY_BUFFER, liveVboId);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(lastUploadBytes),
+            &liveStaging[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
     glutPostRedisplay();
+
+    // Schedule the next frame on a fixed grid, starting over after a stall
+    // instead of trying to catch up.
+    nextFrameTime += LIVE_FRAME_MS;
+    if (nextFrameTime < now) nextFrameTime = now + LIVE_FRAME_MS;
+    double delay = nextFrameTime - glutGet(GLUT_ELAPSED_TIME);
+    glutTimerFunc(static_cast<unsigned int>(std::max(delay, 0.0)), cupdate, 0);
+    liveTimerArmed = true;
 }
 
 //void RenderGL::display()
@@ -310,8 +429,13 @@ void RenderGL::display()
 {
 	// std::cout << "RenderGL::display. Num points:" << numPoints;
 	// std::cout << "  Num lines:" << numLines << std::endl;
+    double startUs = profiler.now();
+    if (lastFrameStart > 0) frameIntervalMs = (startUs - lastFrameStart) / 1000.0;
+    lastFrameStart = startUs;
+
     // clearing the window or remove all drawn objects
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    gpuTimer.begin();
 
     glMatrixMode(GL_PROJECTION);
     glLoadMatrixf(&projMat[0][0]);
@@ -334,32 +458,343 @@ void RenderGL::display()
         glVertex3f(projAxes[2][0], projAxes[2][1], projAxes[2][2]);
     glEnd();
 
+    if (drawMode == DRAW_DENSITY) {
+        refreshDensity();
+        drawDensity();
+    } else if (drawMode == DRAW_LIVE) {
+        drawLive();
+    } else if (drawMode == DRAW_ORBITS && pagedStore) {
+        drawPaged();
+    } else {
+        drawVertices();
+    }
+
+    gpuTimer.end();
+    if (showHud) drawHud();
+
+    // Submission only, the wait for the swap is left out
+    double durationUs = profiler.now() - startUs;
+    frameCpuMs = durationUs / 1000.0;
+    profiler.complete("display", startUs, durationUs);
+    profiler.counters("frame", {{"interval_ms", frameIntervalMs},
+        {"cpu_ms", frameCpuMs}, {"gpu_ms", gpuTimer.lastMs()},
+        {"vertices", static_cast<double>(numDrawnVertices)}});
+    if (profiler.tracing()) {
+        const double MB = 1024.0 * 1024.0;
+        profiler.counters("upload", {{"bytes", static_cast<double>(lastUploadBytes)},
+            {"ms", lastUploadMs}, {"mb_per_s", uploadBandwidth()}});
+        profiler.counters("memory", {{"ram_mb", ramUsage() / MB},
+            {"gpu_mb", gpuMemoryUsage() / MB}});
+    }
+
+    glutSwapBuffers();
+}
+
+namespace {
+
+std::string formatRate(double perSecond)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (perSecond >= 1E6) {
+        out << perSecond / 1E6 << "M";
+    } else if (perSecond >= 1E3) {
+        out << perSecond / 1E3 << "k";
+    } else {
+        out << perSecond;
+    }
+    return out.str();
+}
+
+}
+
+void RenderGL::drawHud()
+{
+    const double MB = 1024.0 * 1024.0;
+    std::vector<std::string> lines;
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(2);
+
+    line << "Frame " << frameIntervalMs << " ms  CPU " << frameCpuMs << " ms  GPU ";
+    if (gpuTimer.lastMs() < 0) {
+        line << "n/a";
+    } else {
+        line << gpuTimer.lastMs() << " ms";
+    }
+    lines.push_back(line.str());
+
+    line.str("");
+    if (drawMode == DRAW_DENSITY) {
+        line << "Vertices binned: " << densityVertices * numLines;
+    } else {
+        line << "Vertices drawn: " << numDrawnVertices;
+    }
+    lines.push_back(line.str());
+
+    line.str("");
+    if (drawMode == DRAW_LIVE) {
+        auto const &live = orbGen.liveSystems();
+        double seconds = std::max(frameIntervalMs, 1E-3) / 1000.0;
+        line << "Live: " << live.numSystems() << " systems, "
+            << live.stepsPerFrame() << " steps/frame, "
+            << formatRate(live.lastFrameSteps() / seconds) << " steps/s";
+    } else {
+        GenerationStats const &gen = orbGen.lastGeneration();
+        double seconds = std::max(gen.ms, 1E-3) / 1000.0;
+        line << "Generation: " << formatRate(gen.orbits / seconds) << " orbits/s, "
+            << formatRate(gen.steps / seconds) << " steps/s";
+        if (gen.allocations >= 0) line << ", " << gen.allocations << " allocations";
+    }
+    lines.push_back(line.str());
+
+    line.str("");
+    if (drawMode == DRAW_LIVE && liveMapped) {
+        line << "Upload: persistently mapped";
+    } else {
+        line << "Upload: " << lastUploadBytes / MB << " MB at "
+            << uploadBandwidth() << " MB/s";
+    }
+    lines.push_back(line.str());
+
+    line.str("");
+    if (pagedStore) {
+        line << "Paged store: " << pageSlots.size() << "/" << PAGE_POOL_SLOTS
+            << " pages on GPU, " << ramUsage() / MB << " MB cached, "
+            << pagedStore->pagesLoaded() << " pages read";
+        if (pagesLeftOut > 0) line << ", " << pagesLeftOut << " overview pages left out";
+    } else {
+        line << "Orbit store: " << ramUsage() / MB << " MB RAM";
+    }
+    line << ", " << gpuMemoryUsage() / MB << " MB GPU";
+    lines.push_back(line.str());
+
+    float width = static_cast<float>(glutGet(GLUT_WINDOW_WIDTH));
+    float height = static_cast<float>(glutGet(GLUT_WINDOW_HEIGHT));
+    float lineStep = 2.0f * 16.0f / height;
+    glDisable(GL_DEPTH_TEST);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        renderString(-1.0f + 2.0f * 8.0f / width, 1.0f - (i + 1) * lineStep,
+            GLUT_BITMAP_HELVETICA_12, lines[i].c_str(), glm::vec3(1, 0.7, 0));
+    }
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Bytes of orbit data in RAM: the page cache of a paged file, otherwise the
+// orbit store
+size_t RenderGL::ramUsage() const
+{
+    return pagedStore ? pagedStore->cachedBytes() : orbGen.memoryUsage();
+}
+
+// MB/s of the last upload to the GPU
+double RenderGL::uploadBandwidth() const
+{
+    return lastUploadBytes / (1024.0 * 1024.0) / (std::max(lastUploadMs, 1E-3) / 1000.0);
+}
+
+// Bytes allocated in the orbit, section and live vertex buffers
+size_t RenderGL::gpuMemoryUsage() const
+{
+    size_t vertices = size_t(numLines) * lineCapacity + numSectionPoints;
+    if (liveVboId != 0) {
+        auto const &live = orbGen.liveSystems();
+        vertices += size_t(live.numSystems()) * live.slotSize();
+    }
+    // Positions and colors
+    size_t bytes = vertices * 6 * sizeof(float);
+    if (pagedStore) {
+        bytes += size_t(PAGE_POOL_SLOTS) * pagedStore->pageVertices() * 3 * sizeof(float);
+    }
+    return bytes;
+}
+
+// Switches the orbit view to the pages of a paged orbit file
+bool RenderGL::openPaged(std::string const &path)
+{
+    std::unique_ptr<PagedOrbitStore> store(new PagedOrbitStore());
+    if (!store->open(path, PAGE_CACHE_BYTES)) return false;
+    pagedStore = std::move(store);
+
+    glDeleteBuffers(1, &pagePoolVboId);
+    glGenBuffers(1, &pagePoolVboId);
+    glBindBuffer(GL_ARRAY_BUFFER, pagePoolVboId);
+    glBufferData(GL_ARRAY_BUFFER,
+        sizeof(float) * PAGE_POOL_SLOTS * pagedStore->pageVertices() * 3, 0,
+        GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    slotPages.assign(PAGE_POOL_SLOTS, -1);
+    slotLastUse.assign(PAGE_POOL_SLOTS, 0);
+    pageSlots.clear();
+    pagesLeftOut = 0;
+    pagedFrame = 0;
+
+    glutPostRedisplay();
+    return true;
+}
+
+unsigned int RenderGL::leastRecentSlot() const
+{
+    return static_cast<unsigned int>(
+        std::min_element(slotLastUse.begin(), slotLastUse.end()) - slotLastUse.begin());
+}
+
+// Draws the pages wanted for the current view that are on the GPU. A page
+// is drawn in place of the pages under it until all of those can be drawn,
+// so that the same vertices are never drawn twice, and without it the pages
+// under it available are drawn. Pages missing from the RAM cache are left to
+// the loader thread, and at most PAGE_UPLOADS_PER_FRAME pages are moved to
+// the GPU per frame, so a view change never stalls a frame.
+void RenderGL::drawPaged()
+{
+    pagedFrame++;
+    float height = static_cast<float>(glutGet(GLUT_WINDOW_HEIGHT));
+    // Matches the 5 degree field of view set in reshape
+    float pixelsPerRadian = height / (2.0f * std::tan(static_cast<float>(2.5 * M_PI / 180.0)));
+    glm::vec3 eyePos = glm::vec3(modelViewMatInv * glm::vec4(0, 0, 0, 1));
+    pagesLeftOut = pagedStore->selectPages(frustumFromMatrix(modelViewProjMat), eyePos,
+        pixelsPerRadian, PAGE_LOD_PIXELS, PAGE_POOL_SLOTS, wantedPages);
+    pagedStore->request(wantedPages);
+
+    // The selection, parents included, fits in the pool; keep it from
+    // eviction
+    for (auto const &wanted : wantedPages) {
+        auto resident = pageSlots.find(wanted.page);
+        if (resident != pageSlots.end()) slotLastUse[resident->second] = pagedFrame;
+    }
+
+    // Pages are uploaded in load order, so parents go first
+    glBindBuffer(GL_ARRAY_BUFFER, pagePoolVboId);
+    unsigned int uploads = 0;
+    double startUs = profiler.now();
+    size_t uploadedBytes = 0;
+    bool poolFull = false;
+    for (auto const &wanted : wantedPages) {
+        if (uploads == PAGE_UPLOADS_PER_FRAME) break;
+        if (pageSlots.count(wanted.page)) continue;
+        PageData data = pagedStore->cachedPage(wanted.page);
+        if (!data) continue;
+        unsigned int slot = leastRecentSlot();
+        if (slotLastUse[slot] == pagedFrame) {
+            poolFull = true;
+            break;
+        }
+        if (slotPages[slot] >= 0) pageSlots.erase(slotPages[slot]);
+        glBufferSubData(GL_ARRAY_BUFFER,
+            sizeof(float) * slot * pagedStore->pageVertices() * 3,
+            sizeof(float) * data->size(), &(*data)[0]);
+        slotPages[slot] = wanted.page;
+        slotLastUse[slot] = pagedFrame;
+        pageSlots[wanted.page] = slot;
+        uploadedBytes += sizeof(float) * data->size();
+        uploads++;
+    }
+    if (uploads > 0) {
+        double durationUs = profiler.now() - startUs;
+        profiler.complete("uploadPages", startUs, durationUs,
+            {{"bytes", static_cast<double>(uploadedBytes)}});
+        lastUploadBytes = uploadedBytes;
+        lastUploadMs = durationUs / 1000.0;
+    }
+
+    // Children come after their parents, so walking backwards settles the
+    // children of a page before the page itself. Pages that failed to load
+    // are not waited for; their parents stay drawn instead.
+    bool waiting = false;
+    wantedStates.assign(wantedPages.size(), WantedState());
+    for (size_t i = wantedPages.size(); i-- > 0;) {
+        PageRequest const &wanted = wantedPages[i];
+        WantedState &state = wantedStates[i];
+        state.resident = pageSlots.count(wanted.page) > 0;
+        if (!state.resident && !pagedStore->pageFailed(wanted.page)) waiting = true;
+        state.covered = state.resident || (state.hasChildren && state.childrenCovered);
+        if (wanted.parent < 0) continue;
+        WantedState &parent = wantedStates[wanted.parent];
+        parent.childrenCovered = (parent.childrenCovered || !parent.hasChildren) && state.covered;
+        parent.hasChildren = true;
+    }
+
+    glUseProgram(shaderId);
+    GLuint mvpId = glGetUniformLocation(shaderId, "modelViewProjMatrix");
+    glUniformMatrix4fv(mvpId, 1, GL_FALSE, &modelViewProjMat[0][0]);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, 0);
+    glLineWidth(2.0);
+
+    numDrawnVertices = 0;
+    for (size_t i = 0; i < wantedPages.size(); ++i) {
+        PageRequest const &wanted = wantedPages[i];
+        WantedState &state = wantedStates[i];
+        if (wanted.parent >= 0) {
+            WantedState const &parent = wantedStates[wanted.parent];
+            state.hidden = parent.hidden || parent.drawn;
+        }
+        state.drawn = !state.hidden && state.resident &&
+            !(state.hasChildren && state.childrenCovered);
+        if (state.drawn) drawPage(wanted.page, pageSlots[wanted.page]);
+    }
+
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+
+    // Keep drawing while pages are on their way. A full pool would never
+    // make room, so it stops the redraws too.
+    if (waiting && !poolFull) glutPostRedisplay();
+}
+
+// Pages hold positions only, the color is constant per orbit. An overview
+// page is drawn as one strip per orbit.
+void RenderGL::drawPage(std::uint32_t page, unsigned int slot)
+{
+    PageInfo const &info = pagedStore->page(page);
+    GLint first = static_cast<GLint>(slot * pagedStore->pageVertices());
+    GLsizei count = info.numVertices;
+    unsigned int numOrbits = 1;
+    if (info.level == OVERVIEW_LEVEL) {
+        count = pagedStore->overviewVertices();
+        numOrbits = info.numVertices / count;
+    }
+    for (unsigned int i = 0; i < numOrbits; ++i) {
+        glm::vec3 const &color = pagedStore->orbitColor(info.orbit + i);
+        glVertexAttrib3f(1, color.x, color.y, color.z);
+        glDrawArrays(GL_LINE_STRIP, first + i * count, count);
+    }
+    numDrawnVertices += info.numVertices;
+}
+
+void RenderGL::drawVertices()
+{
     glUseProgram(shaderId);
     GLuint mvpId = glGetUniformLocation(shaderId, "modelViewProjMatrix");
     glUniformMatrix4fv(mvpId, 1, GL_FALSE, &modelViewProjMat[0][0]);
 
     // bind VBOs before drawing
-    glBindBuffer(GL_ARRAY_BUFFER, vboId);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
+    GLuint drawnVboId = drawMode == DRAW_SECTION ? sectionVboId : vboId;
+    glBindBuffer(GL_ARRAY_BUFFER, drawnVboId);
 
     // enable vertex arrays
     glEnableVertexAttribArray(0);          // activate vertex position array
     glEnableVertexAttribArray(1);          // activate vertex color array
 
-    size_t cOffset = sizeof(float) * numPoints * 3;
+    size_t cOffset = drawMode == DRAW_SECTION ?
+        sizeof(float) * numSectionPoints * 3 :
+        sizeof(float) * numLines * lineCapacity * 3;
 
     // specify vertex arrays with their offsets
     glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, 0);
     glVertexAttribPointer(1, 3, GL_FLOAT, false, 0, (void *)cOffset);
 
-    // finally draw a cube with glDrawElements()
-    glLineWidth(2.0);
-    for (unsigned int i = 0; i < numLines; ++i) {
-        int indexOffset = 4 * i * numPoints / numLines;
-        glDrawElements(GL_LINE_STRIP,
-            numPoints/numLines,
-            GL_UNSIGNED_INT,         // data type
-            (void *)static_cast<intptr_t>(indexOffset));         // offset to
+    if (drawMode == DRAW_SECTION) {
+        numDrawnVertices = numSectionPoints;
+        glPointSize(1.0);
+        glDrawArrays(GL_POINTS, 0, numSectionPoints);
+    } else {
+        cullChunks();
+        glLineWidth(2.0);
+        if (!drawFirsts.empty()) {
+            glMultiDrawArrays(GL_LINE_STRIP, &drawFirsts[0], &drawCounts[0],
+                static_cast<GLsizei>(drawFirsts.size()));
+        }
     }
     // disable vertex arrays
     glDisableVertexAttribArray(0);
@@ -367,12 +802,7 @@ void RenderGL::display()
 
     // unbind VBOs
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glUseProgram(0);
-
-    renderString(0.8, -0.9, GLUT_BITMAP_TIMES_ROMAN_10, "HELLO!", glm::vec3(1,0.7,0));
-
-    glutSwapBuffers();
 }
 
 void RenderGL::reshape(int width, int height)
@@ -381,10 +811,13 @@ void RenderGL::reshape(int width, int height)
         << std::endl;
     // adjusts the pixel rectangle for drawing to be the entire new window
     glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+    density.resize(width, height);
+    densityVertices = 0;
 
     projMat = glm::perspective((float)(5.0 * M_PI / 180),
         (GLfloat)width / (GLfloat)height, 0.1f, 2000.0f);
     viewMat = glm::lookAt(eye, glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
+    modelViewMatInv = glm::inverse(viewMat * modelMat);
     modelViewProjMat = projMat * viewMat * modelMat;
 }
 
@@ -432,72 +865,344 @@ void RenderGL::updateData(std::vector<std::vector<float>> const &lines,
     std::vector<std::vector<float>> const &colors)
 {
 	// std::cout << "updateData: numLines=" << lines.size() << std::endl;
+    if (lines.empty()) return;
+
+    numLines = static_cast<unsigned int>(lines.size());
+    lineLength = static_cast<unsigned int>(lines[0].size() / 3);
+    lineCapacity = lineLength;
+    numPoints = numLines * lineLength;
+
+    // std::cout << "== Stats:" << std::endl;
+    // std::cout << "==              Num. lines:" << lines.size() << std::endl;
+    // std::cout << "==    Num. verts per lines:" << lines[0].size() << std::endl;
+    // std::cout << "==          Total vertices:" << numPoints << std::endl;
+    // std::cout << "==              Total size:"
+    //     << numPoints * 3 * sizeof(float) / 1024 << " kB" << std::endl;
+
+    std::cout << "== Sending data to the GPU." << std::endl;
 
     glDeleteBuffers(1, &vboId);
-    glDeleteBuffers(1, &iboId);
+    glGenBuffers(1, &vboId);
+    allocateBuffer();
+    uploadVertices(lines, colors, 0);
+    densityVertices = 0;
+
+    glutPostRedisplay();
+}
 
-    // create VBOs
-    glGenBuffersARB(1, &vboId);  // for vertex buffer
-    glGenBuffers(1, &iboId);     // for index buffer
+// Uploads the vertices from firstNewVertex onwards, which must be the only
+// ones added to every orbit since the previous updateData/appendData call.
+void RenderGL::appendData(std::vector<std::vector<float>> const &lines,
+    std::vector<std::vector<float>> const &colors,
+    unsigned int firstNewVertex)
+{
+    if (lines.empty()) return;
+    if (numLines != lines.size() || vboId == 0) {
+        updateData(lines, colors);
+        return;
+    }
 
-    numPoints = static_cast<int>(lines.size() * lines[0].size() / 3);
-    numLines = static_cast<int>(lines.size());
+    unsigned int newLength = static_cast<unsigned int>(lines[0].size() / 3);
+    if (newLength > lineCapacity) {
+        unsigned int prevCapacity = lineCapacity;
+        GLuint prevVboId = vboId;
+
+        lineCapacity = std::max(lineCapacity, 1u);
+        while (lineCapacity < newLength) lineCapacity *= 2;
+        std::cout << "== Growing orbit slots to " << lineCapacity
+            << " vertices." << std::endl;
+
+        // Move the vertices already on the GPU to their new slots.
+        glGenBuffers(1, &vboId);
+        allocateBuffer();
+        glBindBuffer(GL_COPY_READ_BUFFER, prevVboId);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vboId);
+        size_t prevColorOffset = sizeof(float) * numLines * prevCapacity * 3;
+        size_t colorOffset = sizeof(float) * numLines * lineCapacity * 3;
+        size_t usedSize = sizeof(float) * lineLength * 3;
+        for (unsigned int i = 0; i < numLines; ++i) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                sizeof(float) * i * prevCapacity * 3,
+                sizeof(float) * i * lineCapacity * 3, usedSize);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                prevColorOffset + sizeof(float) * i * prevCapacity * 3,
+                colorOffset + sizeof(float) * i * lineCapacity * 3, usedSize);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &prevVboId);
+    }
 
-    std::vector<float> vertices;
-    std::vector<float> vertColors;
-    std::vector<unsigned int> indices;
+    uploadVertices(lines, colors, firstNewVertex);
+    lineLength = newLength;
+    numPoints = numLines * lineLength;
 
-    indices.resize(numPoints);
+    glutPostRedisplay();
+}
 
-    for (auto line : lines) {
-        vertices.insert(vertices.end(), std::make_move_iterator(line.begin()),
-            std::make_move_iterator(line.end()));
+void RenderGL::updateSection(std::vector<float> const &points,
+    std::vector<float> const &colors)
+{
+    numSectionPoints = static_cast<unsigned int>(points.size() / 3);
+    std::cout << "== Sending " << numSectionPoints
+        << " section points to the GPU." << std::endl;
+
+    if (sectionVboId == 0) glGenBuffers(1, &sectionVboId);
+    glBindBuffer(GL_ARRAY_BUFFER, sectionVboId);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * (points.size() + colors.size()),
+        0, GL_STATIC_DRAW);
+    if (!points.empty()) {
+        ScopedTimer timer("uploadSection", &lastUploadMs);
+        lastUploadBytes = sizeof(float) * (points.size() + colors.size());
+        timer.setBytes(lastUploadBytes);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * points.size(),
+            &points[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * points.size(),
+            sizeof(float) * colors.size(), &colors[0]);
     }
-    for (auto lineColor : colors) {
-        vertColors.insert(vertColors.end(),
-            std::make_move_iterator(lineColor.begin()),
-            std::make_move_iterator(lineColor.end()));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glutPostRedisplay();
+}
+
+void RenderGL::setDrawMode(DrawMode mode)
+{
+    drawMode = mode;
+    if (drawMode == DRAW_LIVE) {
+        if (liveVboId == 0) startLive();
+        if (!liveTimerArmed) {
+            nextFrameTime = glutGet(GLUT_ELAPSED_TIME);
+            glutTimerFunc(0, cupdate, 0);
+            liveTimerArmed = true;
+        }
     }
-    // std::cout << "== Stats:" << std::endl;
-    // std::cout << "==              Num. lines:" << lines.size() << std::endl;
-    // std::cout << "==    Num. verts per lines:" << lines[0].size() << std::endl;
-    // std::cout << "==          Total vertices:" << numPoints << std::endl;
-    // std::cout << "==              Total size:"
-    //     << numPoints * 3 * sizeof(float) / 1024 << " kB" << std::endl;
+    glutPostRedisplay();
+}
+
+// Starts a new set of live systems and allocates their rings. With
+// ARB_buffer_storage the rings are mapped once and written in place by the
+// integration threads; otherwise they are staged and uploaded every frame.
+void RenderGL::startLive()
+{
+    orbGen.startLive(LIVE_SYSTEMS, LIVE_RING_LENGTH);
+    auto const &live = orbGen.liveSystems();
+    size_t numFloats = size_t(3) * live.numSystems() * live.slotSize();
+
+    if (liveFence) glDeleteSync(liveFence);
+    liveFence = 0;
+    glDeleteBuffers(1, &liveVboId);
+    glGenBuffers(1, &liveVboId);
+    liveMapped = 0;
+    liveStaging.clear();
+
+    // Positions followed by colors
+    std::vector<float> colors(numFloats);
+    live.writeColors(&colors[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, liveVboId);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+            GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, sizeof(float) * numFloats * 2, 0,
+            flags | GL_DYNAMIC_STORAGE_BIT);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * numFloats,
+            sizeof(float) * numFloats, &colors[0]);
+        liveMapped = static_cast<float *>(glMapBufferRange(GL_ARRAY_BUFFER, 0,
+            sizeof(float) * numFloats, flags));
+    }
+    if (liveMapped == 0) {
+        std::cout << "== Persistent mapping unavailable, staging live vertices."
+            << std::endl;
+        liveStaging.assign(numFloats * 2, 0.0f);
+        std::copy(colors.begin(), colors.end(), liveStaging.begin() + numFloats);
+        if (!GLEW_ARB_buffer_storage) {
+            glBufferData(GL_ARRAY_BUFFER, sizeof(float) * numFloats * 2,
+                &liveStaging[0], GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Draws the rings as trails. A ring that has wrapped around is drawn as its
+// older part, up to the mirror of vertex 0, followed by its newer part.
+void RenderGL::drawLive()
+{
+    auto const &live = orbGen.liveSystems();
+    if (liveVboId == 0) return;
+
+    drawFirsts.clear();
+    drawCounts.clear();
+    numDrawnVertices = 0;
+    unsigned int slotSize = live.slotSize();
+    unsigned int ringLength = slotSize - 1;
+    for (unsigned int i = 0; i < live.numSystems(); ++i) {
+        GLint slot = i * slotSize;
+        unsigned int head = live.ringHead(i);
+        unsigned int count = live.ringCount(i);
+        if (count < ringLength || head == 0) {
+            drawFirsts.push_back(slot);
+            drawCounts.push_back(count);
+        } else {
+            drawFirsts.push_back(slot + head);
+            drawCounts.push_back(slotSize - head);
+            drawFirsts.push_back(slot);
+            drawCounts.push_back(head);
+        }
+    }
+    for (auto count : drawCounts) numDrawnVertices += count;
+
+    glUseProgram(shaderId);
+    GLuint mvpId = glGetUniformLocation(shaderId, "modelViewProjMatrix");
+    glUniformMatrix4fv(mvpId, 1, GL_FALSE, &modelViewProjMat[0][0]);
+
+    glBindBuffer(GL_ARRAY_BUFFER, liveVboId);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    size_t cOffset = sizeof(float) * live.numSystems() * slotSize * 3;
+    glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, 0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, false, 0, (void *)cOffset);
+
+    glLineWidth(2.0);
+    if (!drawFirsts.empty()) {
+        glMultiDrawArrays(GL_LINE_STRIP, &drawFirsts[0], &drawCounts[0],
+            static_cast<GLsizei>(drawFirsts.size()));
+    }
+    if (liveMapped) {
+        if (liveFence) glDeleteSync(liveFence);
+        liveFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    glDisableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+// Tests the chunk bounds of every orbit against the view frustum and builds
+// the list of vertex ranges to draw. Runs of visible chunks are merged into
+// a single range.
+void RenderGL::cullChunks()
+{
+    drawFirsts.clear();
+    drawCounts.clear();
+    numDrawnVertices = 0;
 
-    unsigned int curVertexIndex = 0;
-    for (unsigned int curLine = 0; curLine < numLines; ++curLine) {
+    auto const &chunks = orbGen.orbitChunks();
+    if (chunks.size() != numLines) return;
 
-        size_t curLineVerts = lines[curLine].size() / 3;
-        for (unsigned int i = 0; i < curLineVerts; ++i) {
-            indices[curVertexIndex] = curVertexIndex;
-            curVertexIndex++;
+    Frustum frustum = frustumFromMatrix(modelViewProjMat);
+    for (unsigned int i = 0; i < numLines; ++i) {
+        bool extending = false;
+        for (unsigned int c = 0; c < chunks[i].size(); ++c) {
+            unsigned int begin = c * ORBIT_CHUNK_SIZE;
+            if (begin + 1 >= lineLength) break;
+            if (!boxInFrustum(frustum, chunks[i][c].lo, chunks[i][c].hi)) {
+                extending = false;
+                continue;
+            }
+            unsigned int end = std::min(begin + ORBIT_CHUNK_SIZE + 1, lineLength);
+            if (extending) {
+                drawCounts.back() = i * lineCapacity + end - drawFirsts.back();
+            } else {
+                drawFirsts.push_back(i * lineCapacity + begin);
+                drawCounts.push_back(end - begin);
+                extending = true;
+            }
         }
     }
+    for (auto count : drawCounts) numDrawnVertices += count;
+}
+
+// Brings the density map up to date. A view change rebuilds it from scratch,
+// otherwise only vertices appended since the last refresh are binned. While
+// the view is being dragged the previous map is kept, and it is rebuilt once
+// the drag ends.
+void RenderGL::refreshDensity()
+{
+    if (dragging && densityTexId != 0) return;
+    if (densityMvp != modelViewProjMat) {
+        densityMvp = modelViewProjMat;
+        densityVertices = 0;
+    }
+    if (densityVertices == lineLength && densityTexId != 0) return;
+
+    std::vector<unsigned char> rgba;
+    {
+        ScopedTimer timer("refreshDensity");
+        if (densityVertices == 0) density.clear();
+        density.accumulate(orbGen.orbitLines(), densityVertices, densityMvp);
+        densityVertices = lineLength;
+        density.toneMap(rgba);
+    }
+
+    if (densityTexId == 0) glGenTextures(1, &densityTexId);
+    glBindTexture(GL_TEXTURE_2D, densityTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, density.width(), density.height(),
+        0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.empty() ? 0 : &rgba[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void RenderGL::drawDensity()
+{
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
 
-    std::cout << "== Normals computed. Sending data to the GPU." << std::endl;
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, densityTexId);
+    glColor3f(1, 1, 1);
+    glBegin(GL_QUADS);
+        glTexCoord2f(0, 0); glVertex2f(-1, -1);
+        glTexCoord2f(1, 0); glVertex2f( 1, -1);
+        glTexCoord2f(1, 1); glVertex2f( 1,  1);
+        glTexCoord2f(0, 1); glVertex2f(-1,  1);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
 
-    // copy vertex attribs data to VBO
+void RenderGL::allocateBuffer()
+{
     glBindBuffer(GL_ARRAY_BUFFER, vboId);
-    // reserve space
+    // reserve space for positions followed by colors
     glBufferData(
         GL_ARRAY_BUFFER,
-        sizeof(float) * (vertices.size() + vertColors.size()), 0,
+        sizeof(float) * numLines * lineCapacity * 3 * 2, 0,
         GL_STATIC_DRAW);
-    // copy positions
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * vertices.size(),
-        &vertices[0]);
-    // copy colors
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(),
-        sizeof(float) * vertColors.size(), &vertColors[0]);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
-        &indices[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void RenderGL::uploadVertices(std::vector<std::vector<float>> const &lines,
+    std::vector<std::vector<float>> const &colors,
+    unsigned int firstVertex)
+{
+    size_t colorOffset = sizeof(float) * numLines * lineCapacity * 3;
 
-    glutPostRedisplay();
+    ScopedTimer timer("uploadVertices", &lastUploadMs);
+    lastUploadBytes = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, vboId);
+    for (unsigned int i = 0; i < numLines; ++i) {
+        size_t numFloats = lines[i].size() - 3 * firstVertex;
+        if (numFloats == 0) continue;
+        lastUploadBytes += 2 * sizeof(float) * numFloats;
+        size_t slotOffset = sizeof(float) * (i * lineCapacity + firstVertex) * 3;
+        // copy positions
+        glBufferSubData(GL_ARRAY_BUFFER, slotOffset,
+            sizeof(float) * numFloats, &lines[i][3 * firstVertex]);
+        // copy colors
+        glBufferSubData(GL_ARRAY_BUFFER, colorOffset + slotOffset,
+            sizeof(float) * numFloats, &colors[i][3 * firstVertex]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    timer.setBytes(lastUploadBytes);
 }
 
 void RenderGL::setProjAxes(glm::mat3 const &axes)
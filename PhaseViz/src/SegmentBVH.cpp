@@ -0,0 +1,276 @@
+#include "SegmentBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+const int maxBlockSegments = 1 << 16;
+const int maxLeafSize = 4;
+
+int maxThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+int threadId()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+glm::vec3 vertexAt(std::vector<float> const &line, int v)
+{
+    return glm::vec3(line[3*v], line[3*v + 1], line[3*v + 2]);
+}
+
+void buildNode(std::vector<BVHBox> const &boxes, std::vector<int> &order,
+               std::vector<BVHNode> &nodes, int nodeIndex, int begin, int end)
+{
+    glm::vec3 lo = boxes[order[begin]].lo;
+    glm::vec3 hi = boxes[order[begin]].hi;
+    glm::vec3 centerLo = 0.5f*(lo + hi);
+    glm::vec3 centerHi = centerLo;
+    for (int i = begin + 1; i < end; ++i) {
+        BVHBox const &box = boxes[order[i]];
+        lo = glm::min(lo, box.lo);
+        hi = glm::max(hi, box.hi);
+        glm::vec3 center = 0.5f*(box.lo + box.hi);
+        centerLo = glm::min(centerLo, center);
+        centerHi = glm::max(centerHi, center);
+    }
+    nodes[nodeIndex].lo = lo;
+    nodes[nodeIndex].hi = hi;
+
+    glm::vec3 extent = centerHi - centerLo;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    if (end - begin <= maxLeafSize || extent[axis] == 0) {
+        nodes[nodeIndex].first = begin;
+        nodes[nodeIndex].count = end - begin;
+        return;
+    }
+
+    // Median split along the widest axis of the centroids
+    int mid = (begin + end) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+        [&](int a, int b) {
+            return boxes[a].lo[axis] + boxes[a].hi[axis] < boxes[b].lo[axis] + boxes[b].hi[axis];
+        });
+
+    int left = static_cast<int>(nodes.size());
+    nodes.push_back(BVHNode());
+    nodes.push_back(BVHNode());
+    nodes[nodeIndex].first = left;
+    nodes[nodeIndex].count = 0;
+    buildNode(boxes, order, nodes, left, begin, mid);
+    buildNode(boxes, order, nodes, left + 1, mid, end);
+}
+
+// Builds a tree over the boxes. On return order holds the box indices in
+// the order referenced by the leaves.
+void buildTree(std::vector<BVHBox> const &boxes, std::vector<int> &order,
+               std::vector<BVHNode> &nodes)
+{
+    order.resize(boxes.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<int>(i);
+    nodes.clear();
+    if (boxes.empty()) return;
+    nodes.reserve(2*boxes.size() / maxLeafSize + 1);
+    nodes.push_back(BVHNode());
+    buildNode(boxes, order, nodes, 0, 0, static_cast<int>(boxes.size()));
+}
+
+// Slab test of the ray against the node box grown by radius. tEntry receives
+// the ray parameter where the box is entered.
+bool hitBox(BVHNode const &node, glm::vec3 const &origin, glm::vec3 const &invDir,
+            float radius, float maxT, float &tEntry)
+{
+    float t0 = 0, t1 = maxT;
+    for (int axis = 0; axis < 3; ++axis) {
+        float ta = (node.lo[axis] - radius - origin[axis]) * invDir[axis];
+        float tb = (node.hi[axis] + radius - origin[axis]) * invDir[axis];
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        if (t0 > t1) return false;
+    }
+    tEntry = t0;
+    return true;
+}
+
+// Closest approach between the ray origin + s*dir (unit dir, s >= 0) and the
+// segment a + t*(b - a), t in [0, 1].
+float raySegmentDistance(glm::vec3 const &origin, glm::vec3 const &dir,
+                         glm::vec3 const &a, glm::vec3 const &b, float &s, float &t)
+{
+    glm::vec3 d2 = b - a;
+    glm::vec3 r = origin - a;
+    float e = glm::dot(d2, d2);
+    float f = glm::dot(d2, r);
+    float c = glm::dot(dir, r);
+    if (e < 1E-12f) {
+        t = 0;
+        s = std::max(0.0f, -c);
+    } else {
+        float bb = glm::dot(dir, d2);
+        float denom = e - bb*bb;
+        s = denom > 1E-12f ? std::max(0.0f, (bb*f - c*e) / denom) : 0.0f;
+        t = (bb*s + f) / e;
+        if (t < 0) {
+            t = 0;
+            s = std::max(0.0f, -c);
+        } else if (t > 1) {
+            t = 1;
+            s = std::max(0.0f, bb - c);
+        }
+    }
+    return glm::length(origin + s*dir - (a + t*d2));
+}
+
+}
+
+void SegmentBVH::clear()
+{
+    numBlocks = 0;
+    topNodes.clear();
+    blockOrder.clear();
+}
+
+// Indexes the segments of every line ending at or after firstVertex.
+void SegmentBVH::addSegments(std::vector<std::vector<float>> const &lines,
+                             unsigned int firstVertex)
+{
+    newBlocks.clear();
+    for (size_t orbit = 0; orbit < lines.size(); ++orbit) {
+        int numVerts = static_cast<int>(lines[orbit].size() / 3);
+        int first = std::max(static_cast<int>(firstVertex), 1) - 1;
+        for (int v = first; v < numVerts - 1; v += maxBlockSegments) {
+            newBlocks.push_back({static_cast<int>(orbit), v});
+        }
+    }
+
+    size_t firstBlock = numBlocks;
+    numBlocks += newBlocks.size();
+    if (blocks.size() < numBlocks) blocks.resize(numBlocks);
+    if (threadBuffers.size() < static_cast<size_t>(maxThreads())) {
+        threadBuffers.resize(maxThreads());
+    }
+
+#pragma omp parallel
+    {
+        std::vector<BVHBox> &boxes = threadBuffers[threadId()].boxes;
+        std::vector<int> &order = threadBuffers[threadId()].order;
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < static_cast<int>(newBlocks.size()); ++i) {
+            auto const &line = lines[newBlocks[i].orbit];
+            int begin = newBlocks[i].vertex;
+            int end = std::min(begin + maxBlockSegments, static_cast<int>(line.size() / 3) - 1);
+
+            Block &block = blocks[firstBlock + i];
+            boxes.clear();
+            for (int v = begin; v < end; ++v) {
+                glm::vec3 a = vertexAt(line, v);
+                glm::vec3 b = vertexAt(line, v + 1);
+                boxes.push_back({glm::min(a, b), glm::max(a, b)});
+            }
+            buildTree(boxes, order, block.nodes);
+            block.segments.resize(order.size());
+            for (size_t j = 0; j < order.size(); ++j) {
+                block.segments[j] = {newBlocks[i].orbit, begin + order[j]};
+            }
+        }
+    }
+
+    buildTopLevel();
+}
+
+void SegmentBVH::buildTopLevel()
+{
+    topBoxes.clear();
+    for (size_t i = 0; i < numBlocks; ++i) {
+        topBoxes.push_back({blocks[i].nodes[0].lo, blocks[i].nodes[0].hi});
+    }
+    buildTree(topBoxes, blockOrder, topNodes);
+}
+
+// Finds the segment closest to the eye among those passing within radius of
+// the ray. The picked vertex is the segment end closest to the ray.
+bool SegmentBVH::pick(std::vector<std::vector<float>> const &lines,
+                      glm::vec3 const &origin, glm::vec3 const &dir, float radius,
+                      PickResult &result) const
+{
+    if (topNodes.empty()) return false;
+
+    glm::vec3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+    float bestT = std::numeric_limits<float>::max();
+    result.orbit = -1;
+
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        BVHNode const &node = topNodes[stack.back()];
+        stack.pop_back();
+        float tEntry;
+        if (!hitBox(node, origin, invDir, radius, bestT, tEntry)) continue;
+        if (node.count == 0) {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            pickBlock(lines, blocks[blockOrder[i]], origin, dir, invDir, radius,
+                      bestT, result);
+        }
+    }
+    return result.orbit >= 0;
+}
+
+void SegmentBVH::pickBlock(std::vector<std::vector<float>> const &lines, Block const &block,
+                           glm::vec3 const &origin, glm::vec3 const &dir, glm::vec3 const &invDir,
+                           float radius, float &bestT, PickResult &result) const
+{
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        BVHNode const &node = block.nodes[stack[--stackSize]];
+        float tEntry;
+        if (!hitBox(node, origin, invDir, radius, bestT, tEntry)) continue;
+        if (node.count == 0) {
+            stack[stackSize++] = node.first;
+            stack[stackSize++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            SegmentRef const &seg = block.segments[i];
+            auto const &line = lines[seg.orbit];
+            float s, t;
+            float dist = raySegmentDistance(origin, dir, vertexAt(line, seg.vertex),
+                                            vertexAt(line, seg.vertex + 1), s, t);
+            if (dist <= radius && s < bestT) {
+                bestT = s;
+                result.orbit = seg.orbit;
+                result.vertex = t < 0.5f ? seg.vertex : seg.vertex + 1;
+                result.distance = dist;
+            }
+        }
+    }
+}
+
+size_t SegmentBVH::numSegments() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < numBlocks; ++i) total += blocks[i].segments.size();
+    return total;
+}
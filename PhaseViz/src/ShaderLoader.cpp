@@ -0,0 +1,306 @@
+#include "ShaderLoader.h"
+#include "utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+#ifdef PHASEVIZ_EMBEDDED_SHADERS
+struct EmbeddedShader
+{
+    char const *name;
+    char const *source;
+};
+
+// Generated by the Makefile, one entry per shader source it finds
+const EmbeddedShader embeddedShaders[] = {
+#include "shaders/embedded.inc"
+};
+#endif
+
+const char cacheMagic[4] = {'P', 'V', 'P', 'B'};
+
+bool readFile(std::string const &path, std::string &contents)
+{
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream.is_open()) return false;
+    std::stringstream sstr;
+    sstr << stream.rdbuf();
+    contents = sstr.str();
+    return true;
+}
+
+GLuint compileShader(std::string const &name, std::string const &source,
+                     GLenum shader_type)
+{
+    if (source.empty()) return 0;
+    GLuint shaderID = glCreateShader(shader_type);
+
+    GLint result = GL_FALSE;
+    int infoLogLength;
+
+    // Compile Shader
+    std::cout << "Compiling shader : " << name << std::endl;
+    char const *sourcePointer = source.c_str();
+    glShaderSource(shaderID, 1, &sourcePointer, NULL);
+    glCompileShader(shaderID);
+
+    // Check Shader
+    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
+    glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
+    if (infoLogLength > 0) {
+        std::vector<char> shaderErrorMessage(infoLogLength + 1);
+        glGetShaderInfoLog(shaderID, infoLogLength, NULL,
+            &shaderErrorMessage[0]);
+        std::cout << &shaderErrorMessage[0] << std::endl;
+    }
+
+    return shaderID;
+}
+
+GLuint linkProgram(std::string const &vertexName, std::string const &vertexSource,
+                   std::string const &fragmentName, std::string const &fragmentSource,
+                   bool retrievable)
+{
+    // Create the shaders
+    GLuint vertexShaderID = compileShader(vertexName, vertexSource, GL_VERTEX_SHADER);
+    GLuint fragmentShaderID = compileShader(fragmentName, fragmentSource, GL_FRAGMENT_SHADER);
+
+    // Link the program
+    std::cout << "Linking program" << std::endl;
+    GLuint programID = glCreateProgram();
+    glAttachShader(programID, vertexShaderID);
+    glAttachShader(programID, fragmentShaderID);
+    if (retrievable) {
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(programID);
+
+    // Check the program
+    GLint result = GL_FALSE;
+    int infoLogLength;
+    glGetProgramiv(programID, GL_LINK_STATUS, &result);
+    glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
+    if (infoLogLength > 0) {
+        std::vector<char> programErrorMessage(infoLogLength + 1);
+        glGetProgramInfoLog(programID, infoLogLength, NULL,
+            &programErrorMessage[0]);
+        std::cout << &programErrorMessage[0] << std::endl;
+    }
+
+    glDetachShader(programID, vertexShaderID);
+    glDetachShader(programID, fragmentShaderID);
+
+    glDeleteShader(vertexShaderID);
+    glDeleteShader(fragmentShaderID);
+
+    return programID;
+}
+
+// Directory for the program binaries, created if needed. Empty when there is
+// no suitable place for it.
+std::string cacheDirectory()
+{
+#if defined(_WIN32) || defined(WIN32)
+    char const *localAppData = std::getenv("LOCALAPPDATA");
+    if (!localAppData || !*localAppData) return "";
+    std::string dir = std::string(localAppData) + "\\PhaseViz";
+#else
+    std::string base;
+    char const *xdgCache = std::getenv("XDG_CACHE_HOME");
+    char const *home = std::getenv("HOME");
+    if (xdgCache && *xdgCache) {
+        base = xdgCache;
+    } else if (home && *home) {
+        base = std::string(home) + "/.cache";
+        if (!makeDirectory(base)) return "";
+    } else {
+        return "";
+    }
+    std::string dir = base + "/phaseviz";
+#endif
+    return makeDirectory(dir) ? dir : "";
+}
+
+// 64-bit FNV-1a
+unsigned long long hashString(std::string const &data,
+                              unsigned long long hash = 14695981039346656037ULL)
+{
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Program binaries are only valid for the driver that produced them, so the
+// driver strings are part of the key along with the sources.
+std::string cachePath(std::string const &vertexSource,
+                      std::string const &fragmentSource)
+{
+    std::string dir = cacheDirectory();
+    if (dir.empty()) return "";
+
+    unsigned long long hash = hashString("");
+    GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (GLenum name : strings) {
+        char const *value = reinterpret_cast<char const *>(glGetString(name));
+        hash = hashString(value ? value : "", hash);
+        hash = hashString(std::string(1, '\0'), hash);
+    }
+    hash = hashString(vertexSource, hash);
+    hash = hashString(std::string(1, '\0'), hash);
+    hash = hashString(fragmentSource, hash);
+
+    std::ostringstream path;
+    path << dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+        << hash << ".bin";
+    return path.str();
+}
+
+// Returns 0 if the binary is missing or rejected by the driver
+GLuint loadCachedProgram(std::string const &path)
+{
+    std::string contents;
+    if (!readFile(path, contents)) return 0;
+    size_t headerSize = sizeof(cacheMagic) + sizeof(GLenum);
+    if (contents.size() <= headerSize ||
+        contents.compare(0, sizeof(cacheMagic), cacheMagic, sizeof(cacheMagic)) != 0) {
+        return 0;
+    }
+    GLenum format;
+    contents.copy(reinterpret_cast<char *>(&format), sizeof(format), sizeof(cacheMagic));
+
+    GLuint programID = glCreateProgram();
+    glProgramBinary(programID, format, contents.data() + headerSize,
+        static_cast<GLsizei>(contents.size() - headerSize));
+    GLint result = GL_FALSE;
+    glGetProgramiv(programID, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE) {
+        glDeleteProgram(programID);
+        return 0;
+    }
+    return programID;
+}
+
+void storeProgram(GLuint programID, std::string const &path)
+{
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(programID, length, NULL, &format, &binary[0]);
+
+    // Another instance may be loading the same binary, so it is written to
+    // a temporary file and moved in place once complete.
+    std::ostringstream tmpPath;
+    tmpPath << path << "."
+        << std::chrono::high_resolution_clock::now().time_since_epoch().count() << ".tmp";
+    std::FILE *f = std::fopen(tmpPath.str().c_str(), "wb");
+    bool ok = f != 0 &&
+        std::fwrite(cacheMagic, 1, sizeof(cacheMagic), f) == sizeof(cacheMagic) &&
+        std::fwrite(&format, sizeof(format), 1, f) == 1 &&
+        std::fwrite(&binary[0], 1, binary.size(), f) == binary.size();
+    if (f && std::fclose(f) != 0) ok = false;
+    if (!ok || !replaceFile(tmpPath.str(), path)) {
+        std::cout << "Unable to write " << path << std::endl;
+        std::remove(tmpPath.str().c_str());
+    }
+}
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+}
+
+}
+
+std::string shaderSource(std::string const &name)
+{
+    std::string source;
+    char const *shaderDir = std::getenv("PHASEVIZ_SHADER_DIR");
+    if (shaderDir && *shaderDir) {
+        if (readFile(std::string(shaderDir) + "/" + name, source)) return source;
+        std::cout << "Unable to open " << name << " in " << shaderDir << std::endl;
+    }
+#ifdef PHASEVIZ_EMBEDDED_SHADERS
+    for (auto const &shader : embeddedShaders) {
+        if (name == shader.name) return shader.source;
+    }
+#endif
+    if (!readFile(name, source)) {
+        std::cout << "Unable to open " << name << std::endl;
+    }
+    return source;
+}
+
+GLuint loadProgram(std::string const &vertexName, std::string const &fragmentName)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string vertexSource = shaderSource(vertexName);
+    std::string fragmentSource = shaderSource(fragmentName);
+
+    std::string path;
+    if (GLEW_ARB_get_program_binary && !vertexSource.empty() &&
+        !fragmentSource.empty()) {
+        path = cachePath(vertexSource, fragmentSource);
+    }
+    GLuint programID = path.empty() ? 0 : loadCachedProgram(path);
+    bool cacheHit = programID != 0;
+    if (!cacheHit) {
+        programID = linkProgram(vertexName, vertexSource, fragmentName,
+            fragmentSource, !path.empty());
+        if (!path.empty()) storeProgram(programID, path);
+    }
+
+    std::cout << "Program " << vertexName << " + " << fragmentName << " ready in "
+        << elapsedMs(start) << " ms ("
+        << (cacheHit ? "cached binary" : "compiled") << ")" << std::endl;
+    return programID;
+}
+
+int benchmarkProgramCache(std::string const &vertexName,
+                          std::string const &fragmentName, int iterations)
+{
+    std::string vertexSource = shaderSource(vertexName);
+    std::string fragmentSource = shaderSource(fragmentName);
+    std::string path;
+    if (GLEW_ARB_get_program_binary) path = cachePath(vertexSource, fragmentSource);
+    if (path.empty()) {
+        std::cout << "Program binaries are not available" << std::endl;
+        return 1;
+    }
+    glDeleteProgram(loadProgram(vertexName, fragmentName));
+
+    double compiledMs = 0;
+    double cachedMs = 0;
+    int cacheHits = 0;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        GLuint programID = linkProgram(vertexName, vertexSource, fragmentName,
+            fragmentSource, false);
+        compiledMs += elapsedMs(start);
+        glDeleteProgram(programID);
+
+        start = std::chrono::high_resolution_clock::now();
+        programID = loadCachedProgram(path);
+        cachedMs += elapsedMs(start);
+        if (programID != 0) cacheHits++;
+        glDeleteProgram(programID);
+    }
+
+    std::cout << "* Program cache benchmark, " << iterations << " iterations" << std::endl
+        << "    Compiled (ms):" << compiledMs / iterations << std::endl
+        << "      Cached (ms):" << cachedMs / iterations << std::endl
+        << "       Cache hits:" << cacheHits << "/" << iterations << std::endl;
+    return cacheHits == iterations ? 0 : 1;
+}
@@ -0,0 +1,621 @@
+#if defined(_WIN32) || defined(WIN32)
+#include <Windows.h>
+#include <process.h>
+#define getpid _getpid
+#elif defined __unix__
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "SweepJob.h"
+#include "ColumnExporter.h"
+#include "OrbitGenerator.h"
+#include "PagedOrbitFile.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace {
+
+const char shardMagic[4] = {'P', 'V', 'S', 'H'};
+const char orbitsMagic[4] = {'P', 'V', 'O', 'R'};
+const unsigned int fileVersion = 1;
+
+// Vertices added to every orbit of a shard between lock refreshes and
+// checkpoint opportunities.
+const int batchVertices = 500;
+
+bool fileExists(std::string const &path)
+{
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    std::fclose(f);
+    return true;
+}
+
+// Closes the file after making sure its contents reached the disk.
+bool closeDurably(FILE *f)
+{
+    bool ok = std::fflush(f) == 0;
+#ifdef __unix__
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    return std::fclose(f) == 0 && ok;
+}
+
+template<class T>
+bool writeArray(FILE *f, T const *values, size_t count)
+{
+    return count == 0 || std::fwrite(values, sizeof(T), count, f) == count;
+}
+
+template<class T>
+bool readArray(FILE *f, T *values, size_t count)
+{
+    return count == 0 || std::fread(values, sizeof(T), count, f) == count;
+}
+
+bool writeHeader(FILE *f, char const magic[4], int numOrbits)
+{
+    return writeArray(f, magic, 4) && writeArray(f, &fileVersion, 1) &&
+        writeArray(f, &numOrbits, 1);
+}
+
+bool readHeader(FILE *f, char const magic[4], int &numOrbits)
+{
+    char fileMagic[4];
+    unsigned int version;
+    return readArray(f, fileMagic, 4) && std::memcmp(fileMagic, magic, 4) == 0 &&
+        readArray(f, &version, 1) && version == fileVersion &&
+        readArray(f, &numOrbits, 1) && numOrbits >= 0;
+}
+
+bool writeOrbit(FILE *f, std::vector<ThreeBodySystem> const &states,
+                std::vector<float> const &line)
+{
+    unsigned int numVerts = static_cast<unsigned int>(states.size());
+    return writeArray(f, &numVerts, 1) &&
+        writeArray(f, states.data(), states.size()) &&
+        writeArray(f, line.data(), line.size());
+}
+
+std::string hostName()
+{
+#if defined(_WIN32) || defined(WIN32)
+    char const *name = std::getenv("COMPUTERNAME");
+    return name && *name ? name : "localhost";
+#else
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) != 0 || !name[0]) return "localhost";
+    return name;
+#endif
+}
+
+// Whether a process of this host is still running
+bool processAlive(int pid)
+{
+#if defined(_WIN32) || defined(WIN32)
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+    if (!process) return GetLastError() == ERROR_ACCESS_DENIED;
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    return kill(pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+// Worker ids are <host>/<pid>/<start time>. The owner of a lock is known to
+// be gone when it ran on this host and its process has exited, or when its
+// pid is now that of this worker.
+bool ownerGone(std::string const &owner, std::string const &workerId)
+{
+    size_t hostEnd = owner.find('/');
+    size_t pidEnd = owner.find('/', hostEnd + 1);
+    if (hostEnd == std::string::npos || pidEnd == std::string::npos ||
+        owner.compare(0, hostEnd, hostName()) != 0) {
+        return false;
+    }
+    int pid = std::atoi(owner.substr(hostEnd + 1, pidEnd - hostEnd - 1).c_str());
+    if (pid == static_cast<int>(getpid())) return owner != workerId;
+    return pid > 0 && !processAlive(pid);
+}
+
+// Worker ids contain slashes, which cannot appear in file names
+std::string fileNameTag(std::string const &workerId)
+{
+    std::string tag = workerId;
+    std::replace(tag.begin(), tag.end(), '/', '_');
+    return tag;
+}
+
+// Lock files hold the time of their last refresh followed by the id of the
+// worker owning them.
+bool readLock(std::string const &path, long long &lockTime, std::string &owner)
+{
+    std::ifstream in(path);
+    return static_cast<bool>(in >> lockTime >> owner);
+}
+
+bool writeLock(FILE *f, std::string const &owner)
+{
+    std::fprintf(f, "%lld %s\n", static_cast<long long>(std::time(NULL)), owner.c_str());
+    return std::fclose(f) == 0;
+}
+
+// Distinct colors for the orbits of a paged file, stepping the hue by the
+// golden ratio.
+glm::vec3 sweepOrbitColor(long long orbit)
+{
+    double hue = std::fmod(orbit * 0.618033988749895, 1.0) * 6.0;
+    float x = static_cast<float>(1.0 - std::fabs(std::fmod(hue, 2.0) - 1.0));
+    glm::vec3 rgb[6] = {{1, x, 0}, {x, 1, 0}, {0, 1, x}, {0, x, 1}, {x, 0, 1}, {1, 0, x}};
+    return glm::vec3(0.3f) + 0.7f * rgb[static_cast<int>(hue) % 6];
+}
+
+}
+
+// Shard files hold, for every orbit, its cursor followed by the vertices
+// computed so far. They are written to a temporary file and then moved in
+// place.
+bool writeShard(std::string const &path, ShardData const &data)
+{
+    std::string tmpPath = path + ".tmp";
+    FILE *f = std::fopen(tmpPath.c_str(), "wb");
+    if (!f) {
+        std::cout << "Unable to open " << tmpPath << std::endl;
+        return false;
+    }
+
+    int numOrbits = static_cast<int>(data.cursors.size());
+    bool ok = writeHeader(f, shardMagic, numOrbits);
+    for (int i = 0; ok && i < numOrbits; ++i) {
+        ok = writeArray(f, &data.cursors[i], 1) &&
+            writeOrbit(f, data.states[i], data.lines[i]);
+    }
+    ok = closeDurably(f) && ok;
+    if (!ok || !replaceFile(tmpPath, path)) {
+        std::cout << "Unable to write " << path << std::endl;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readShard(std::string const &path, ShardData &data)
+{
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    int numOrbits;
+    bool ok = readHeader(f, shardMagic, numOrbits);
+    if (ok) {
+        data.cursors.resize(numOrbits);
+        data.states.assign(numOrbits, std::vector<ThreeBodySystem>());
+        data.lines.assign(numOrbits, std::vector<float>());
+    }
+    for (int i = 0; ok && i < numOrbits; ++i) {
+        unsigned int numVerts;
+        ok = readArray(f, &data.cursors[i], 1) && readArray(f, &numVerts, 1);
+        if (!ok) break;
+        data.states[i].resize(numVerts);
+        data.lines[i].resize(3*numVerts);
+        ok = readArray(f, data.states[i].data(), numVerts) &&
+            readArray(f, data.lines[i].data(), 3*numVerts);
+    }
+    std::fclose(f);
+
+    if (!ok) std::cout << "Ignoring damaged shard file " << path << std::endl;
+    return ok;
+}
+
+SweepJob::SweepJob(std::string const &jobDir, SweepConfig const &defaults) :
+    dir(jobDir),
+    config(defaults)
+{
+    std::ostringstream id;
+    id << hostName() << "/" << getpid() << "/"
+        << std::chrono::steady_clock::now().time_since_epoch().count();
+    workerId = id.str();
+}
+
+// Reads the job parameters. Unless create is set the job must already exist,
+// otherwise the directory and job.cfg are created from the defaults when
+// missing.
+bool SweepJob::open(bool create)
+{
+    if (!loadConfig()) {
+        if (!create) {
+            std::cout << "No job in " << dir << std::endl;
+            return false;
+        }
+        makeDirectory(dir);
+        saveConfig();
+        // Another worker may have created the job at the same time
+        if (!loadConfig()) {
+            std::cout << "Unable to create a job in " << dir << std::endl;
+            return false;
+        }
+    }
+
+    // Step control depends on the projection, so every worker must use the
+    // same one to produce the same orbits.
+    srand(config.seed);
+    solver.randomProjection();
+    return true;
+}
+
+int SweepJob::numShards() const
+{
+    return (config.numOrbits + config.shardSize - 1) / config.shardSize;
+}
+
+// Processes shards until all are finished. Shards locked by other workers
+// are waited for, and taken over if their lock goes stale. Returns the
+// number of shards finished by this worker.
+int SweepJob::runWorker()
+{
+    std::cout << "Job " << dir << ": " << config.numOrbits << " orbits of "
+        << config.numPoints << " vertices in " << numShards() << " shards"
+        << std::endl;
+
+    int numProcessed = 0;
+    int numWaiting = 0;
+    while (true) {
+        int numLocked = 0;
+        for (int shard = 0; shard < numShards(); ++shard) {
+            if (fileExists(shardPath(shard, "done"))) continue;
+            if (!claimShard(shard)) {
+                numLocked++;
+                continue;
+            }
+            // It may have been finished between the check and the claim
+            if (!fileExists(shardPath(shard, "done"))) {
+                if (processShard(shard)) numProcessed++;
+            }
+            releaseShard(shard);
+        }
+        if (numLocked == 0) break;
+        if (numLocked != numWaiting) {
+            std::cout << "Waiting for " << numLocked << " shards locked by other workers"
+                << std::endl;
+            numWaiting = numLocked;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(std::max(config.checkpointSeconds, 1)));
+    }
+    finishShardExport();
+
+    int numPending = 0;
+    for (int shard = 0; shard < numShards(); ++shard) {
+        if (!fileExists(shardPath(shard, "done"))) numPending++;
+    }
+    std::cout << "Worker finished " << numProcessed << " shards. "
+        << numPending << " shards pending." << std::endl;
+    return numProcessed;
+}
+
+// Concatenates the output of all shards, in orbit order, into orbits.bin,
+// and their columns into the columns directory. Shards without columns, from
+// a worker that stopped while exporting them, are exported again.
+bool SweepJob::merge()
+{
+    for (int shard = 0; shard < numShards(); ++shard) {
+        if (!fileExists(shardPath(shard, "done"))) {
+            std::cout << "Shard " << shard << " is not finished" << std::endl;
+            return false;
+        }
+    }
+
+    std::string path = dir + "/orbits.bin";
+    std::string tmpPath = path + ".tmp";
+    FILE *f = std::fopen(tmpPath.c_str(), "wb");
+    if (!f) {
+        std::cout << "Unable to open " << tmpPath << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> columnDirs;
+    PagedOrbitWriter pages;
+    bool ok = pages.open(dir + "/orbits.pvpg") &&
+        writeHeader(f, orbitsMagic, config.numOrbits) &&
+        writeArray(f, &config.numPoints, 1);
+    for (int shard = 0; ok && shard < numShards(); ++shard) {
+        ShardData data;
+        ok = readShard(shardPath(shard, "done"), data);
+        for (size_t i = 0; ok && i < data.states.size(); ++i) {
+            long long orbit = shard * config.shardSize + static_cast<long long>(i);
+            ok = writeOrbit(f, data.states[i], data.lines[i]);
+            int paged = pages.addOrbit(sweepOrbitColor(orbit));
+            pages.addVertices(paged, data.lines[i].data(), data.lines[i].size() / 3);
+            pages.endOrbit(paged);
+        }
+        columnDirs.push_back(shardPath(shard, "columns"));
+        if (ok && !fileExists(columnDirs.back() + "/offsets.npy")) {
+            exportShard(shard, data);
+            ok = finishShardExport();
+        }
+    }
+    ok = closeDurably(f) && ok;
+    ok = ok && ColumnExporter::concatenate(columnDirs, dir + "/columns");
+    ok = pages.finish() && ok;
+    if (!ok || !replaceFile(tmpPath, path)) {
+        std::cout << "Unable to write " << path << std::endl;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    std::cout << "Merged " << numShards() << " shards into " << path << std::endl;
+    return true;
+}
+
+bool SweepJob::loadConfig()
+{
+    std::ifstream in(dir + "/job.cfg");
+    if (!in.is_open()) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        long long value;
+        if (!std::getline(fields, key, '=') || !(fields >> value)) continue;
+        if (key == "orbits") config.numOrbits = static_cast<int>(value);
+        else if (key == "points") config.numPoints = static_cast<int>(value);
+        else if (key == "shard_size") config.shardSize = static_cast<int>(value);
+        else if (key == "checkpoint_seconds") config.checkpointSeconds = static_cast<int>(value);
+        else if (key == "seed") config.seed = static_cast<unsigned int>(value);
+    }
+    return true;
+}
+
+void SweepJob::saveConfig() const
+{
+    std::string path = dir + "/job.cfg";
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath);
+        out << "orbits=" << config.numOrbits << std::endl
+            << "points=" << config.numPoints << std::endl
+            << "shard_size=" << config.shardSize << std::endl
+            << "checkpoint_seconds=" << config.checkpointSeconds << std::endl
+            << "seed=" << config.seed << std::endl;
+    }
+    replaceFile(tmpPath, path);
+}
+
+// A lock whose owner has exited, or that has not been refreshed for a long
+// while, belongs to a dead worker and may be taken over. A lock that cannot
+// be read, from a worker that died while creating it, counts as refreshed
+// when this worker first saw it. The lock is first renamed to a name unique
+// to this worker, which only one of several competing workers can succeed
+// at. The renamed lock must still be the stale one that was read: if its
+// owner refreshed it, or another worker took it over, in between, it is put
+// back.
+bool SweepJob::claimShard(int shard)
+{
+    std::string lock = shardPath(shard, "lock");
+    FILE *f = std::fopen(lock.c_str(), "wx");
+    if (!f) {
+        long long now = static_cast<long long>(std::time(NULL));
+        long long lockTime;
+        std::string owner;
+        if (readLock(lock, lockTime, owner)) {
+            unreadableLocks.erase(shard);
+        } else {
+            lockTime = unreadableLocks.insert(std::make_pair(shard, now)).first->second;
+            owner.clear();
+        }
+
+        long long staleSeconds = 3LL*config.checkpointSeconds + 60;
+        if (now - lockTime < staleSeconds && !ownerGone(owner, workerId)) return false;
+
+        std::string stolen = lock + "." + fileNameTag(workerId);
+        if (std::rename(lock.c_str(), stolen.c_str()) != 0) return false;
+        long long stolenTime;
+        std::string stolenOwner;
+        bool unchanged = owner.empty() ?
+            !readLock(stolen, stolenTime, stolenOwner) :
+            readLock(stolen, stolenTime, stolenOwner) && stolenTime == lockTime &&
+                stolenOwner == owner;
+        if (!unchanged) {
+            std::rename(stolen.c_str(), lock.c_str());
+            return false;
+        }
+        std::remove(stolen.c_str());
+        unreadableLocks.erase(shard);
+        std::cout << "Taking over stale lock of shard " << shard << " from worker "
+            << (owner.empty() ? "unknown" : owner) << std::endl;
+
+        f = std::fopen(lock.c_str(), "wx");
+        if (!f) return false;
+    }
+    return writeLock(f, workerId);
+}
+
+bool SweepJob::ownsLock(int shard) const
+{
+    long long lockTime;
+    std::string owner;
+    return readLock(shardPath(shard, "lock"), lockTime, owner) && owner == workerId;
+}
+
+void SweepJob::releaseShard(int shard)
+{
+    if (ownsLock(shard)) std::remove(shardPath(shard, "lock").c_str());
+}
+
+// Refreshes the lock of a shard being processed. Returns false, leaving the
+// lock alone, when another worker has taken it over, and also when the lock
+// could not be rewritten, since it would then go stale.
+bool SweepJob::touchLock(int shard) const
+{
+    if (!ownsLock(shard)) return false;
+    std::string lock = shardPath(shard, "lock");
+    std::string tmpPath = lock + "." + fileNameTag(workerId) + ".tmp";
+    FILE *f = std::fopen(tmpPath.c_str(), "w");
+    if (!f || !writeLock(f, workerId) || !replaceFile(tmpPath, lock)) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Returns false when the shard was given up because its lock was lost or
+// could not be refreshed.
+bool SweepJob::processShard(int shard)
+{
+    ShardData data;
+    std::string checkpoint = shardPath(shard, "ckpt");
+    if (readShard(checkpoint, data)) {
+        std::cout << "Resuming shard " << shard << " from checkpoint" << std::endl;
+    } else {
+        std::cout << "Starting shard " << shard << std::endl;
+        startShard(shard, data);
+    }
+
+    int numOrbits = static_cast<int>(data.cursors.size());
+    auto start = std::chrono::steady_clock::now();
+    auto lastCheckpoint = start;
+    long long numSteps = 0;
+    bool complete = false;
+    while (!complete) {
+        long long batchSteps = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:batchSteps)
+        for (int i = 0; i < numOrbits; ++i) {
+            int remaining = config.numPoints - static_cast<int>(data.states[i].size());
+            if (remaining <= 0) continue;
+            batchSteps += solver.extendOrbit(data.cursors[i], std::min(batchVertices, remaining),
+                                             data.states[i], data.lines[i]);
+        }
+        numSteps += batchSteps;
+
+        complete = true;
+        for (int i = 0; i < numOrbits; ++i) {
+            complete = complete && static_cast<int>(data.states[i].size()) >= config.numPoints;
+        }
+        if (!touchLock(shard)) {
+            std::cout << "Unable to keep the lock of shard " << shard << ", giving it up"
+                << std::endl;
+            return false;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (!complete && now - lastCheckpoint >= std::chrono::seconds(config.checkpointSeconds)) {
+            if (writeShard(checkpoint, data)) {
+                std::cout << "Checkpointed shard " << shard << std::endl;
+            }
+            lastCheckpoint = now;
+        }
+    }
+
+    if (writeShard(shardPath(shard, "done"), data)) {
+        std::remove(checkpoint.c_str());
+        exportShard(shard, data);
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "Finished shard " << shard << ": " << numSteps << " steps in "
+        << duration << " ms" << std::endl;
+    return true;
+}
+
+// Initial conditions of a shard only depend on the job seed and the shard
+// index, so a shard restarted from scratch reproduces the same orbits.
+void SweepJob::startShard(int shard, ShardData &data)
+{
+    int firstOrbit = shard * config.shardSize;
+    int numOrbits = std::min(config.shardSize, config.numOrbits - firstOrbit);
+
+    srand(config.seed + 7919u * static_cast<unsigned int>(shard + 1));
+    data.cursors.clear();
+    for (int i = 0; i < numOrbits; ++i) {
+        data.cursors.push_back(solver.startOrbit(randomSystem()));
+    }
+    data.states.assign(numOrbits, std::vector<ThreeBodySystem>());
+    data.lines.assign(numOrbits, std::vector<float>());
+}
+
+// Hands the orbits of a finished shard to the column writer thread, which
+// writes them while the next shard is integrated. The columns go to a
+// temporary directory that is renamed once complete.
+void SweepJob::exportShard(int shard, ShardData &data)
+{
+    finishShardExport();
+    shardExportDir = shardPath(shard, "columns");
+    shardExporter.reset(new ColumnExporter(shardExportDir + ".tmp"));
+    long long firstOrbit = shard * static_cast<long long>(config.shardSize);
+    for (size_t i = 0; i < data.states.size(); ++i) {
+        shardExporter->submit(firstOrbit + static_cast<long long>(i),
+            std::move(data.states[i]), std::move(data.lines[i]));
+    }
+}
+
+bool SweepJob::finishShardExport()
+{
+    if (!shardExporter) return true;
+    bool ok = shardExporter->finish();
+    shardExporter.reset();
+    std::string tmpDir = shardExportDir + ".tmp";
+    if (!ok || std::rename(tmpDir.c_str(), shardExportDir.c_str()) != 0) {
+        std::cout << "Unable to write " << shardExportDir << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string SweepJob::shardPath(int shard, char const *extension) const
+{
+    std::ostringstream path;
+    path << dir << "/shard_" << shard << "." << extension;
+    return path.str();
+}
+
+// PhaseViz --job <dir> [--orbits N] [--points N] [--shard-size N]
+//                      [--checkpoint-secs N] [--seed N]
+// PhaseViz --merge <dir>
+int runSweepCommand(int argc, char **argv)
+{
+    SweepConfig config = {1000, 8000, 16, 60, 1};
+
+    std::string command = argv[1];
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " " << command << " <job dir> [options]" << std::endl;
+        return 1;
+    }
+    for (int i = 3; i < argc; i += 2) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << option << std::endl;
+            return 1;
+        }
+        int value = std::atoi(argv[i + 1]);
+        if (option == "--orbits") config.numOrbits = value;
+        else if (option == "--points") config.numPoints = value;
+        else if (option == "--shard-size") config.shardSize = std::max(value, 1);
+        else if (option == "--checkpoint-secs") config.checkpointSeconds = value;
+        else if (option == "--seed") config.seed = static_cast<unsigned int>(value);
+        else {
+            std::cout << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    SweepJob job(argv[2], config);
+    if (!job.open(command != "--merge")) return 1;
+    if (command == "--merge") {
+        return job.merge() ? 0 : 1;
+    }
+    job.runWorker();
+    return 0;
+}
@@ -26,6 +26,33 @@ SystemAccels computeAccelerations(ThreeBodySystem s)
     return result;
 }
 
+// Phase space coordinates ordered as in Projection: the three body positions
+// followed by the three body velocities.
+void toPhaseVector(ThreeBodySystem const &s, double x[PHASE_DIMS])
+{
+    for (int b = 0; b < 3; ++b) {
+        for (int c = 0; c < 3; ++c) {
+            x[3*b + c] = s.body[b].position[c];
+            x[9 + 3*b + c] = s.body[b].velocity[c];
+        }
+    }
+}
+
+// Total energy, with the unit masses and gravitational constant used by
+// computeAccelerations
+double systemEnergy(ThreeBodySystem const &s)
+{
+    double kinetic = 0;
+    for (int b = 0; b < 3; ++b) {
+        kinetic += 0.5*glm::dot(s.body[b].velocity, s.body[b].velocity);
+    }
+    double potential =
+        -1.0/glm::length(s.body[0].position - s.body[1].position)
+        - 1.0/glm::length(s.body[0].position - s.body[2].position)
+        - 1.0/glm::length(s.body[1].position - s.body[2].position);
+    return kinetic + potential;
+}
+
 ThreeBodySolver::ThreeBodySolver() :
     occupancy(10*10*10, 0)
 //    coloredBody(0)
@@ -46,56 +73,100 @@ std::pair<std::vector<ThreeBodySystem>, std::vector<float>> ThreeBodySolver::com
 {
     std::vector<ThreeBodySystem> orbitStates;
     std::vector<float> orbitVertices;
-    std::vector<float> orbitColor;
-
-    int numSteps = 0;
-    int numVerts = 0;
+    // The length is known, so the buffers are allocated once
+    orbitStates.reserve(numPoints);
+    orbitVertices.reserve(3*numPoints);
 
-    glm::vec3 color = randomVector(0.5) + glm::dvec3(0.5);
+    OrbitCursor cursor = startOrbit(tbs);
+    extendOrbit(cursor, numPoints, orbitStates, orbitVertices);
+    tbs = cursor.state;
 
-    glm::vec3 lastVert(0);
-    glm::vec3 lastOrbitPoint(0);
+    return std::make_pair(std::move(orbitStates), std::move(orbitVertices));
+}
 
-    double tStep = 0.01;
+OrbitCursor ThreeBodySolver::startOrbit(ThreeBodySystem const &tbs)
+{
+    return {tbs, 0.01, glm::vec3(0), glm::vec3(0), 0};
+}
 
+// Integrates until numPoints more vertices have been appended to the orbit.
+// Everything needed to continue later is kept in the cursor, so calling this
+// repeatedly produces the same orbit as a single longer call. Returns the
+// number of integration steps taken.
+int ThreeBodySolver::extendOrbit(OrbitCursor &cursor, int numPoints,
+                                 std::vector<ThreeBodySystem> &orbitStates,
+                                 std::vector<float> &orbitVertices)
+{
+    int firstStep = cursor.numSteps;
+    int numVerts = 0;
     auto prevTime = std::chrono::high_resolution_clock::now();
     while (numVerts < numPoints) {
-        advanceStep(tbs, tStep);
-        glm::vec3 projected = p.phaseSpaceToVizSpace(tbs);
-        double distToLastPoint = glm::length(projected - lastOrbitPoint);
-
-        if (distToLastPoint > 1E-3 && numSteps != 0) {
-            // Undo last step
-            advanceStep(tbs, -tStep);
-            tStep *= 0.5;
-            continue;
-        } else if (distToLastPoint < 1E-4) {
-            // We are doing tiny steps. Make them longer in next iter.
-            tStep *= 2;
-        }
-        double distToLastVert = glm::length(projected - lastVert);
-        lastOrbitPoint = projected;
-        if ((distToLastVert > 1E-1) ||
-            ((distToLastVert > 5E-2) && (numSteps % 100 == 1))) {
-            lastVert = projected;
+        glm::vec3 projected;
+        if (stepOrbit(cursor, projected)) {
             orbitVertices.push_back(projected[0]);
             orbitVertices.push_back(projected[1]);
             orbitVertices.push_back(projected[2]);
-            orbitStates.push_back(tbs);
+            orbitStates.push_back(cursor.state);
             numVerts++;
         }
-        numSteps++;
     }
     auto curTime = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(curTime - prevTime).count();
     // std::cout << "* Orbit stats" << std::endl <<
     //     "---------------" << std::endl <<
-    //     "    Total steps:" << numSteps << std::endl <<
+    //     "    Total steps:" << cursor.numSteps - firstStep << std::endl <<
     //     "       Vertices:" << numVerts << std::endl <<
     //     "       Time(ms):" << duration << std::endl <<
-    //     "        Steps/s:" << numSteps*1000.0/duration << std::endl;
+    //     "        Steps/s:" << (cursor.numSteps - firstStep)*1000.0/duration << std::endl;
 
-    return std::make_pair(orbitStates, orbitVertices);
+    return cursor.numSteps - firstStep;
+}
+
+// Advances the orbit by one adaptive step. Returns true when the new state is
+// far enough from the last emitted vertex to become a vertex itself, which is
+// then stored in vertex.
+bool ThreeBodySolver::stepOrbit(OrbitCursor &cursor, glm::vec3 &vertex)
+{
+    double usedStep;
+    glm::vec3 projected = advanceAdaptive(cursor, usedStep);
+    double distToLastVert = glm::length(projected - cursor.lastVert);
+    bool emitted = (distToLastVert > 1E-1) ||
+        ((distToLastVert > 5E-2) && (cursor.numSteps % 100 == 1));
+    if (emitted) {
+        cursor.lastVert = projected;
+        vertex = projected;
+    }
+    cursor.numSteps++;
+    return emitted;
+}
+
+// Takes one step, halving the step size until the projected point moves less
+// than the tolerance. usedStep receives the size of the step actually taken.
+// The caller is responsible for incrementing cursor.numSteps.
+glm::vec3 ThreeBodySolver::advanceAdaptive(OrbitCursor &cursor, double &usedStep)
+{
+    ThreeBodySystem &tbs = cursor.state;
+    double &tStep = cursor.tStep;
+
+    while (true) {
+        advanceStep(tbs, tStep);
+        glm::vec3 projected = p.phaseSpaceToVizSpace(tbs);
+        double distToLastPoint = glm::length(projected - cursor.lastOrbitPoint);
+
+        if (distToLastPoint > 1E-3 && cursor.numSteps != 0) {
+            // Undo last step
+            advanceStep(tbs, -tStep);
+            tStep *= 0.5;
+            continue;
+        }
+        usedStep = tStep;
+        if (distToLastPoint < 1E-4) {
+            // We are doing tiny steps. Make them longer in next iter.
+            tStep *= 2;
+        }
+        cursor.lastOrbitPoint = projected;
+        return projected;
+    }
 }
 
 void ThreeBodySolver::advanceStep(ThreeBodySystem &tbs, double tStep)
@@ -123,3 +194,13 @@ glm::vec3 ThreeBodySolver::projectSystem(ThreeBodySystem const &tbs)
 {
     return p.phaseSpaceToVizSpace(tbs);
 }
+
+void ThreeBodySolver::setProjection(double const rows[3][PHASE_DIMS], double const center[PHASE_DIMS])
+{
+    p.setRows(rows, center);
+}
+
+void ThreeBodySolver::randomProjection()
+{
+    p.createMatrix();
+}
@@ -5,17 +5,28 @@
 #endif
 
 #include "RenderGL.h"
+#include "ShaderLoader.h"
+#include "SweepJob.h"
 
 #include <ctime>
 #include <GL/glut.h>
+#include <string>
 
 // main function
 int main(int argc, char **argv)
 {
     srand(time(NULL));
     //    srand(time(NULL));
+    // Headless generation jobs
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--job" || command == "--merge") {
+        return runSweepCommand(argc, argv);
+    }
     // initialize glut
     initGLRendering(argc, argv);
+    if (command == "--shader-benchmark") {
+        return benchmarkProgramCache("rotate.vert", "phase.frag", 20);
+    }
     glutMainLoop();
     return 0;
 }
@@ -1,8 +1,40 @@
+#if defined(_WIN32) || defined(WIN32)
+#include <Windows.h>
+#include <direct.h>
+#elif defined __unix__
+#include <sys/stat.h>
+#endif
+
 #include "utils.h"
 
+#include <cerrno>
+#include <cstdio>
+
 glm::dvec3 randomVector(double scale)
 {
     return glm::dvec3((rand() / (RAND_MAX + 1.0) - 0.5)*2*scale,
         (rand() / (RAND_MAX + 1.0) - 0.5)*2*scale,
         (rand() / (RAND_MAX + 1.0) - 0.5)*2*scale);
 }
+
+// Creates the directory unless it already exists
+bool makeDirectory(std::string const &path)
+{
+#if defined(_WIN32) || defined(WIN32)
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// Moves tmpPath over path in a single step, so that readers of path see
+// either the old or the new contents but never a partial file.
+bool replaceFile(std::string const &tmpPath, std::string const &path)
+{
+#if defined(_WIN32) || defined(WIN32)
+    return MoveFileExA(tmpPath.c_str(), path.c_str(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+}